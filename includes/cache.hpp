@@ -0,0 +1,80 @@
+#pragma once
+
+#include "file.hpp"
+#include "loader.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @file cache.hpp
+ * @brief Persistent on disk cache of finished textures.
+ *
+ * @details
+ * Stores the final mip chain of a texture, either raw pixels or compressed blocks, and the
+ * Toksvig variance of normal map levels in a single file named after a key. Keys are hashes
+ * of the source file and of every option that changes the result, so a cached texture is
+ * reused until one of them changes.
+ */
+
+/** @brief Mapped cache file and the mip levels inside it. */
+struct CachedTexture
+{
+	FileView file{};
+	std::vector<MipLevelView> levels;
+};
+
+/**
+ * @brief Static texture cache.
+ *
+ * @details
+ * Cache files are written to a temporary name and renamed once complete, so concurrent
+ * processes never read a partially written file. Failing to read or write the cache is
+ * not an error, the texture is then simply loaded from its source.
+ *
+ * Typical usage:
+ * - Optionally choose the directory with @ref SetDirectory().
+ * - Build a key with @ref Hash() over the source bytes and the options.
+ * - Try @ref Load() and otherwise create the texture and @ref Store() it.
+ */
+class TextureCache
+{
+	private:
+		static std::string directory;
+
+		static std::string GetFilePath(uint64_t key);
+
+	public:
+		/**
+		 * @brief Sets the directory cache files are stored in.
+		 * @param path Directory, created when the first texture is stored.
+		 */
+		static void SetDirectory(const std::string& path);
+		static std::string GetDirectory();
+
+		/**
+		 * @brief Hashes a range of bytes.
+		 * @param data Start of the bytes.
+		 * @param size Number of bytes.
+		 * @param seed Previous hash to combine with.
+		 * @return 64-bit hash.
+		 */
+		static uint64_t Hash(const void* data, size_t size, uint64_t seed = 0);
+
+		/**
+		 * @brief Maps the cache file of a key.
+		 * @param key Key of the texture.
+		 * @param texture Receives the mapping and its mip levels.
+		 * @return True if a valid cache file was found.
+		 */
+		static bool Load(uint64_t key, CachedTexture& texture);
+
+		/**
+		 * @brief Writes a mip chain to the cache file of a key.
+		 * @param key Key of the texture.
+		 * @param levels Mip levels in order.
+		 * @return True if the file was written.
+		 */
+		static bool Store(uint64_t key, const std::vector<MipLevel>& levels);
+};
@@ -44,6 +44,7 @@ struct DeviceConfig
 	bool nonUniformIndexingShaderSampledImageArray = false;
 	bool multiDrawIndirect = false;
 	bool synchronization2 = true;
+	bool storageWriteWithoutFormat = false; /**< @brief Allows writing storage images declared without a format, needed by the mipmap compute shader which falls back to blits without it. */
 };
 
 /** @brief Contains information about different queue families. */
@@ -107,6 +108,7 @@ class Device
 		 * @return True if the logical device exists.
 		 */
 		const bool Created() const;
+		const DeviceConfig& GetConfig() const;
 		VkPhysicalDevice& GetPhysicalDevice();
 		const VkPhysicalDevice& GetPhysicalDevice() const;
 		VkDevice& GetLogicalDevice();
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+/**
+ * @file file.hpp
+ * @brief Read only memory mapped file access.
+ *
+ * @details
+ * Provides a view over the contents of a file that is mapped into memory instead of copied,
+ * so parsers read straight from the page cache and repeated loads of the same asset share
+ * its pages.
+ */
+
+/** @brief Expected access pattern of a mapped file, passed to the OS as a paging hint. */
+enum class FileAccess { Sequential, Random };
+
+/**
+ * @brief Read only memory mapped view of a whole file.
+ *
+ * @details
+ * The mapping lives as long as the view, pointers into it become invalid once it is destroyed
+ * or moved from. Empty files produce a valid view without data.
+ */
+class FileView
+{
+	private:
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+
+#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#else
+		int descriptor = -1;
+#endif
+
+		void Close();
+
+	public:
+		FileView();
+
+		/**
+		 * @brief Maps a file into memory.
+		 * @param path Path to the file.
+		 * @param access Expected access pattern.
+		 */
+		FileView(const std::string& path, FileAccess access = FileAccess::Sequential);
+		~FileView();
+
+		FileView(const FileView&) = delete;
+		FileView& operator=(const FileView&) = delete;
+		FileView(FileView&& other) noexcept;
+		FileView& operator=(FileView&& other) noexcept;
+
+		/**
+		 * @brief Changes the paging hint of a range of the file.
+		 * @param access Expected access pattern.
+		 * @param offset Start of the range in bytes.
+		 * @param length Length of the range in bytes, clamped to the end of the file.
+		 */
+		void Advise(FileAccess access, size_t offset = 0, size_t length = SIZE_MAX) const;
+
+		/** @brief Asks the OS to start paging in a range that will be read soon. */
+		void Prefetch(size_t offset, size_t length) const;
+
+		const uint8_t* GetData() const;
+		size_t GetSize() const;
+		std::string_view GetString() const;
+};
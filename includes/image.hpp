@@ -50,6 +50,7 @@ struct ImageViewConfig
 	VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
 	VkComponentMapping components{};
 	VkImageSubresourceRange subresourceRange{};
+	VkImageUsageFlags usage = 0; /**< @brief Usage of the view when it has to be narrower than the image, 0 inherits the image usage. */
 };
 
 /**
@@ -72,11 +73,16 @@ struct ImageConfig
 	bool srgb = false;
 	bool compressed = false;
 	bool normal = false;
+	CompressionType compressionType = CompressionType::None; /**< @brief Block format of compressed images, None picks BC5 for normal maps and BC1 otherwise. */
+	bool cached = false; /**< @brief Reuse the final mip chain from the texture cache while the source file and these options are unchanged. */
+	bool computeMipmaps = false; /**< @brief Generate uncompressed mip levels with the mipmap compute shader instead of a chain of blits, falls back to blits when the format cannot be written as a storage image. */
 
 	ImageViewConfig viewConfig{};
 	ImageSamplerConfig samplerConfig{};
 };
 
+class Buffer;
+
 /**
  * @brief Vulkan image wrapper.
  *
@@ -104,9 +110,24 @@ class Image
 		VkSampler sampler = nullptr;
 		VkDeviceMemory memory = nullptr;
 
+		std::vector<MipLevel> variance{};
+
 		void CreateImage();
 		void CreateMipmaps();
+		void CreateComputeMipmaps();
+		void GenerateMipmaps();
+		bool SupportsComputeMipmaps() const;
 		void CreateCompressedMipmaps(const ImageLoader& imageLoader);
+		void Stream(const ImageLoader& imageLoader);
+		void Upload(Buffer& stagingBuffer, Point<uint32_t, 3> extent = {}, Point<int32_t, 4> offset = {}, bool transition = true);
+		void LoadCached(const ImageLoader& imageLoader);
+		std::vector<MipLevel> LoadLevels(const ImageLoader& imageLoader) const;
+		uint64_t GetCacheKey(const ImageLoader& imageLoader) const;
+		void KeepVariance(const std::vector<MipLevelView>& levels);
+		bool ValidCachedLevels(const std::vector<MipLevelView>& levels) const;
+		CompressionType GetCompressionType() const;
+		void UploadLevels(const std::vector<MipLevelView>& levels);
+		void UploadLevel(const MipLevelView& level, bool transition);
 		void CreateView();
 		void CreateSampler();
 		void AllocateMemory();
@@ -139,6 +160,12 @@ class Image
 		const VkSampler& GetSampler() const;
 		const ImageConfig& GetConfig() const;
 
+		/**
+		 * @brief Toksvig variance of every mip level of a compressed normal map, for adjusting roughness in the shader.
+		 * @return Levels with one byte per pixel, 255 meaning 1, empty unless the loader was configured with normalVariance.
+		 */
+		const std::vector<MipLevel>& GetVariance() const;
+
 		void TransitionLayout();
 
 		/**
@@ -183,4 +210,7 @@ class Image
 		 * @param device Device used to create the view; if @c nullptr, uses the stored device.
 		 */
 		static void CreateView(VkImageView& view, const VkImage& image, const ImageViewConfig& config, Device* device = nullptr);
+
+		/** @brief Destroys the shared compute pipeline used by @ref ImageConfig::computeMipmaps, it is recreated on next use. */
+		static void DestroyMipmapPipeline();
 };
\ No newline at end of file
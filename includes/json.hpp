@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file json.hpp
+ * @brief Single pass JSON parser.
+ *
+ * @details
+ * Parses a whole document in one pass into a flat table of values stored in document order.
+ * Keys, strings and numbers are kept as ranges of the source text, so the source has to outlive
+ * the document and parsing allocates nothing per value besides the table itself. Numbers are
+ * only converted when they are read.
+ */
+
+enum class JsonType : uint8_t { Null, Boolean, Number, String, Array, Object };
+
+class JsonDocument;
+
+/**
+ * @brief Handle to a value of a parsed document.
+ *
+ * @details
+ * Looking up a missing member or element returns an invalid value instead of throwing,
+ * so optional fields are read with a fallback: @c value["byteStride"].Integer(0).
+ */
+class JsonValue
+{
+	private:
+		const JsonDocument* document = nullptr;
+		uint32_t index = 0;
+
+	public:
+		/** @brief Iterates over the members of an object or the elements of an array. */
+		class Iterator
+		{
+			private:
+				const JsonDocument* document = nullptr;
+				uint32_t index = 0;
+
+			public:
+				Iterator(const JsonDocument* iteratorDocument, uint32_t iteratorIndex);
+
+				JsonValue operator*() const;
+				Iterator& operator++();
+				bool operator!=(const Iterator& other) const;
+		};
+
+		JsonValue();
+		JsonValue(const JsonDocument* valueDocument, uint32_t valueIndex);
+
+		bool Valid() const;
+		JsonType Type() const;
+		bool Is(JsonType type) const;
+
+		/** @brief Name of the value if it is an object member, empty otherwise. */
+		std::string_view Key() const;
+
+		/** @brief Number of members or elements, zero for other types. */
+		size_t Size() const;
+
+		/** @brief Member with a name, invalid if this is not an object or the member is missing. */
+		JsonValue operator[](std::string_view key) const;
+
+		/** @brief Element at an index, invalid if this is not an array or the index is out of range. */
+		JsonValue operator[](size_t element) const;
+
+		double Number(double fallback = 0.0) const;
+		size_t Integer(size_t fallback = 0) const;
+		bool Boolean(bool fallback = false) const;
+
+		/** @brief Contents of a string without the quotes, escape sequences are left as they are. */
+		std::string_view String(std::string_view fallback = "") const;
+
+		Iterator begin() const;
+		Iterator end() const;
+};
+
+/**
+ * @brief Parsed JSON document.
+ *
+ * @details
+ * Every value knows the index one past its last descendant, so the children of a container are
+ * walked by jumping from sibling to sibling without visiting their contents.
+ */
+class JsonDocument
+{
+	private:
+		/** @brief Value kept small, as large documents have hundreds of thousands of them. */
+		struct Node
+		{
+			JsonType type = JsonType::Null;
+			uint32_t size = 0;
+			uint32_t end = 0; /**< @brief Index one past the last descendant. */
+			uint32_t key = 0;
+			uint32_t keyLength = 0;
+			uint32_t text = 0;
+			uint32_t textLength = 0;
+		};
+
+		std::vector<Node> nodes;
+		std::string_view source;
+		size_t position = 0;
+
+		void SkipWhitespace();
+		void ParseString(uint32_t& start, uint32_t& length);
+		void ParseValue(uint32_t key, uint32_t keyLength, size_t depth);
+		void ParseNumber(Node& node);
+		std::string_view Text(uint32_t start, uint32_t length) const;
+		[[noreturn]] void Fail(const std::string& message) const;
+
+		friend class JsonValue;
+
+	public:
+		JsonDocument();
+
+		/**
+		 * @brief Parses a document.
+		 * @param text Source text, has to outlive the document.
+		 */
+		JsonDocument(std::string_view text);
+
+		void Parse(std::string_view text);
+
+		/** @brief Top level value of the document. */
+		JsonValue Root() const;
+};
@@ -1,8 +1,9 @@
 #pragma once
 
 #include "point.hpp"
+#include "matrix.hpp"
 #include "vertex.hpp"
-#include "structures.hpp"
+#include "file.hpp"
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -13,8 +14,12 @@
 #include <array>
 #include <string>
 #include <iostream>
+#include <functional>
+#include <memory>
+#include <mutex>
 
-#define FAST_BITS 8
+#define FAST_BITS 9
+#define INFLATE_FAST_BITS 10
 #define CST(a) static_cast<size_t>(a)
 #define C8(a) static_cast<uint8_t>(a)
 #define C16(a) static_cast<uint16_t>(a)
@@ -34,16 +39,19 @@ static const std::array<size_t, 64> zigzagTable =
 
 static const float sqrt12 = 1.0 / sqrt(2);
 
-enum class ModelType { None, Obj, Gltf };
+enum class ModelType { None, Obj, Gltf, Glb };
 enum class AttributeType { None, Position, Normal, Coordinate, Color, Index };
-enum class ImageType { None, Jpg, Png };
-enum class CompressionType { None, BC1, BC5 };
+enum class ImageType { None, Jpg, Png, Ktx2 };
+enum class CompressionType { None, BC1, BC3, BC4, BC5, BC7 };
+enum class CompressionMode { Fast, Quality };
+enum class MipFilter { Box, Kaiser, Lanczos };
 enum class ImageMarker 
 	{ 
 		SOI = 0xD8,
 		EOI = 0xD9,
 		SOS = 0xDA,
 		SOF0 = 0xC0,
+		SOF2 = 0xC2,
 		APP0 = 0xE0,
 		APP1 = 0xE1,
 		APP2 = 0xE2,
@@ -64,28 +72,105 @@ enum class ImageMarker
 		DQT = 0xDB,
 		DHT = 0xC4,
 		DRI = 0xDD,
+		RST0 = 0xD0,
+		RST7 = 0xD7,
 	};
 
+/** @brief Location and layout of a model attribute inside its buffer file. */
 struct AttributeInfo
 {
-	std::string accessContent = "";
-	std::string viewContent = "";
-
-	std::string viewIndex;
-	std::string bufferIndex;
-
-	std::string count;
-	std::string component;
-	std::string type;
-	std::string buffer;
-	std::string length;
-	std::string offset;
-	std::string translation = "0, 0, 0";
-
-	size_t Count() const { return (std::stoul(count)); }
-	size_t Offset() const { return (std::stoul(offset)); }
-	size_t Length() const { return (std::stoul(length)); }
-	point3D Translation() const;
+	size_t accessor = 0;
+	size_t viewIndex = 0;
+	size_t bufferIndex = 0;
+
+	size_t count = 0;
+	size_t component = 0; /**< @brief glTF component type, 5126 for float. */
+	size_t components = 0; /**< @brief Components per element, 3 for VEC3. */
+	bool normalized = false;
+	size_t stride = 0; /**< @brief Bytes between the starts of two elements. */
+	size_t length = 0; /**< @brief Bytes from the start of the first element to the end of the last one. */
+	size_t offset = 0;
+
+	size_t Count() const { return (count); }
+	size_t Offset() const { return (offset); }
+	size_t Length() const { return (length); }
+};
+
+/** @brief Typed glTF accessor. */
+struct GltfAccessor
+{
+	size_t bufferView = SIZE_MAX;
+	size_t byteOffset = 0;
+	size_t componentType = 0;
+	size_t count = 0;
+	size_t components = 0;
+	bool normalized = false;
+};
+
+/** @brief Typed glTF buffer view. */
+struct GltfBufferView
+{
+	size_t buffer = 0;
+	size_t byteOffset = 0;
+	size_t byteLength = 0;
+	size_t byteStride = 0;
+};
+
+/** @brief Typed glTF buffer. */
+struct GltfBuffer
+{
+	std::string uri = "";
+	size_t byteLength = 0;
+};
+
+/** @brief Accessor indices of a mesh primitive, SIZE_MAX for missing attributes. */
+struct GltfPrimitive
+{
+	size_t mesh = 0;
+	size_t position = SIZE_MAX;
+	size_t normal = SIZE_MAX;
+	size_t coordinate = SIZE_MAX;
+	size_t color = SIZE_MAX;
+	size_t indices = SIZE_MAX;
+};
+
+/** @brief Typed glTF mesh, its primitives are a range of the primitive table. */
+struct GltfMesh
+{
+	std::string name = "";
+	size_t primitive = 0;
+	size_t primitiveCount = 0;
+	std::vector<size_t> nodes; /**< @brief Nodes of the scene that draw the mesh, one per instance. */
+};
+
+/** @brief Typed glTF node. */
+struct GltfNode
+{
+	std::string name = "";
+	size_t mesh = SIZE_MAX;
+	mat4 local = mat4::Identity(); /**< @brief Transform relative to the parent, from its matrix or its translation, rotation and scale. */
+	mat4 world = mat4::Identity(); /**< @brief Transform relative to the scene. */
+	std::vector<size_t> children;
+};
+
+/**
+ * @brief Tables of a glTF file, built once while parsing its JSON.
+ *
+ * @details
+ * Meshes, accessors and views refer to each other by index into these tables, as in the file.
+ * The primitives of all meshes are stored in one table in file order, which is the order
+ * mesh IDs of the model loader follow. World transforms and the nodes drawing each mesh are
+ * resolved once from the hierarchy of the default scene.
+ */
+struct GltfInfo
+{
+	std::vector<GltfAccessor> accessors;
+	std::vector<GltfBufferView> bufferViews;
+	std::vector<GltfBuffer> buffers;
+	std::vector<GltfMesh> meshes;
+	std::vector<GltfPrimitive> primitives;
+	std::vector<GltfNode> nodes;
+	std::vector<size_t> roots; /**< @brief Top level nodes of the default scene. */
 };
 
 /** @brief Contains information about a model. */
@@ -99,6 +184,7 @@ struct ModelInfo
 	VertexConfig vertexConfig = None;
 	VkIndexType indexConfig = VK_INDEX_TYPE_NONE_KHR;
 	std::map<AttributeType, AttributeInfo> attributes;
+	std::vector<mat4> instances; /**< @brief World transform of every node drawing the mesh, identity if the file has no nodes. */
 
 	const AttributeInfo& GetAttribute(const AttributeType& type) const;
 };
@@ -114,13 +200,15 @@ struct SOF0Info
 	std::vector<Point<size_t, 4>> components;
 };
 
+typedef std::array<uint16_t, 64> QuantizationTable;
+
 struct DQTInfo
 {
 	size_t start = 0;
 	size_t length = 0;
 	size_t precision = 0;
 	size_t ID = 0;
-	std::array<uint16_t, 64> values{};
+	QuantizationTable values{};
 };
 
 struct HuffmanCode
@@ -146,16 +234,84 @@ struct SOSInfo
 	size_t length = 0;
 	size_t componentCount = 0;
 	std::map<size_t, std::pair<size_t, size_t>> componentTables{};
+	size_t spectralStart = 0;
+	size_t spectralEnd = 63;
+	size_t approximationHigh = 0;
+	size_t approximationLow = 0;
+	size_t huffmanCount = 0; /**< @brief Number of huffman tables defined before this scan. */
+	size_t restartInterval = 0;
+};
+
+/** @brief Header and chunk layout of a PNG file. */
+struct PNGInfo
+{
+	size_t width = 0;
+	size_t height = 0;
+	size_t bitDepth = 0;
+	size_t colorType = 0;
+	size_t interlace = 0;
+
+	std::vector<std::array<uint8_t, 4>> palette;
+	bool transparent = false; /**< @brief Whether a tRNS chunk gives a transparent color or palette alpha. */
+	std::array<uint16_t, 3> transparentColor{};
+
+	std::vector<std::pair<size_t, size_t>> dataChunks; /**< @brief Offset and length of every IDAT chunk. */
+};
+
+/** @brief Entry of the huffman lookahead table, indexed by the next FAST_BITS bits of the scan. */
+struct HuffmanEntry
+{
+	int16_t value = 0;
+	uint8_t symbol = 0;
+	uint8_t codeLength = 0;
+	uint8_t totalLength = 0;
+};
+
+/**
+ * @brief Table driven huffman decoder.
+ *
+ * @details
+ * Codes of up to FAST_BITS bits are resolved with a single lookup. When the magnitude bits
+ * of a code fit in the same lookahead the entry also holds the decoded value. Longer codes
+ * fall back to the canonical maxCode/valueOffset arrays.
+ */
+struct HuffmanTable
+{
+	std::array<HuffmanEntry, 1 << FAST_BITS> lookup{};
+	std::array<int32_t, 18> maxCode{};
+	std::array<int32_t, 17> valueOffset{};
+	std::array<uint8_t, 256> symbols{};
+};
+
+struct HuffmanValue
+{
+	uint8_t symbol = 0;
+	int value = 0;
 };
 
-typedef std::pair<bool, HuffmanCode> HuffmanResult;
-typedef BinaryTree<HuffmanResult> HuffmanTree;
 typedef std::array<int16_t, 64> DataBlock;
 
-struct HuffmanTreeInfo
+struct MipLevel
+{
+	size_t width = 0;
+	size_t height = 0;
+	size_t level = 0;
+
+	std::vector<unsigned char> pixels{};
+	std::vector<unsigned char> variance{}; /**< @brief Toksvig variance of normal map levels, one byte per pixel with 255 meaning 1, empty unless requested. */
+};
+
+/** @brief Mip level whose pixels or blocks live in memory owned by someone else, such as a mapped file. */
+struct MipLevelView
 {
-	HuffmanTree& root;
-	std::map<std::string, uint8_t> mappedCodes;
+	size_t width = 0;
+	size_t height = 0;
+	size_t level = 0;
+
+	const unsigned char* pixels = nullptr;
+	size_t size = 0;
+	const unsigned char* variance = nullptr; /**< @brief Toksvig variance of normal map levels, null unless stored. */
+	size_t varianceSize = 0;
 };
 
 /** @brief Contains information about a texture. */
@@ -168,9 +324,43 @@ struct ImageInfo
 	std::vector<DQTInfo> quantizationTables;
 	std::vector<DHTInfo> huffmanInfos;
 	SOSInfo startOfScanInfo{};
+	std::vector<SOSInfo> scans;
+	PNGInfo pngInfo{};
+	size_t restartInterval = 0;
 	bool greyScale = false;
+	bool progressive = false;
+
+	VkFormat format = VK_FORMAT_UNDEFINED; /**< @brief Format of the stored levels of a container. */
+	std::vector<MipLevelView> levels; /**< @brief Levels stored in a container, pointing into the mapped file. */
+};
+
+/** @brief Size and position of a component's blocks inside an MCU and the huffman tables they are coded with. */
+struct BlockLayout
+{
+	size_t horizontal = 1;
+	size_t vertical = 1;
+	size_t offset = 0;
+	size_t DCTable = 0;
+	size_t ACTable = 0;
 };
 
+/** @brief Options used when decoding a texture. */
+struct ImageLoaderConfig
+{
+	bool fancyUpsampling = false;
+	bool streaming = false; /**< @brief Decode on demand one MCU row at a time instead of keeping all blocks in memory. */
+	size_t progressiveScans = 0; /**< @brief Stop after this many scans of a progressive image for a quick preview, 0 decodes all scans. */
+	size_t scaleLevel = 0; /**< @brief Decode at 1 / 2^scaleLevel of the full resolution (0 to 3) with reduced IDCTs, level 3 only uses the DC coefficients. */
+	bool deferred = false; /**< @brief Decode when the pixels are first requested instead of in the constructor, so textures found in a cache are never decoded. */
+	CompressionMode compressionMode = CompressionMode::Fast; /**< @brief Fast fits BC endpoints once, Quality also refines them against the chosen indices. */
+	MipFilter mipFilter = MipFilter::Box; /**< @brief Downsampling filter of generated mip levels, Kaiser and Lanczos keep more detail at the cost of slight ringing. */
+	bool normalMap = false; /**< @brief Load the texture as a tangent space normal map, RG for JPEG and PNG, with mip levels averaged as vectors and renormalized. */
+	bool normalVariance = false; /**< @brief Also store the Toksvig variance of every normal map mip level, for adjusting roughness in the shader. */
+};
+
+/** @brief Receives rowCount finished pixel rows starting at row. */
+typedef std::function<void(const unsigned char* pixels, size_t row, size_t rowCount)> PixelRowCallback;
+
 struct ImageData
 {
 	Point<size_t, 3> MCUCount{};
@@ -178,23 +368,23 @@ struct ImageData
 	Point<size_t, 3> dimensions{};
 	Point<size_t, 3> subSampling{};
 	Point<size_t, 2> maxHV{};
-	size_t subSamplePower = 1;
 
-	std::vector<HuffmanTree> huffmanTables;
-	std::vector<std::array<int16_t, 1 << FAST_BITS>> fastHuffmanTables;
+	std::vector<HuffmanTable> huffmanTables;
 
 	std::vector<DataBlock> blocks;
+	std::vector<uint8_t> blockEnds;
+	std::vector<QuantizationTable> blockQuantization;
+	std::vector<BlockLayout> layouts;
+	size_t MCUBlockCount = 0;
+	size_t residentRows = 0;
+	size_t blockSize = 8;
+	size_t restartInterval = 0;
 
-	bool normalMap = false;
-};
-
-struct MipLevel
-{
-	size_t width = 0;
-	size_t height = 0;
-	size_t level = 0;
+	std::vector<uint8_t> scanlines; /**< @brief Unfiltered rows of a PNG at their stored bit depth. */
+	size_t scanlineSize = 0;
 
-	std::vector<unsigned char> pixels{};
+	bool normalMap = false;
+	bool fancyUpsampling = false;
 };
 
 class ByteReader
@@ -212,55 +402,185 @@ class ByteReader
 		uint8_t Read8();
 		uint16_t Read16();
 		uint32_t Read32();
+		uint8_t Peek8(size_t offset = 0) const;
+		uint64_t Peek64() const;
 		void Skip(size_t bytes);
 
 		bool AtMarker(ImageMarker marker);
 		ImageMarker NextMarker();
 };
 
+/**
+ * @brief Reads huffman coded bits from a JPEG scan.
+ *
+ * @details
+ * Bits are kept MSB first in a 64-bit accumulator. Refills load eight bytes at once when none
+ * of them is 0xFF and only fall back to the byte stuffing path otherwise. Once a marker is
+ * reached the reader stops consuming bytes and pads the accumulator with zeros.
+ */
 class EntropyReader
 {
 	private:
 		ByteReader& br;
-		bool bitValue = false;
-		uint16_t bitBuffer = 0;
-		size_t index = 16;
-		uint8_t previous = 0;
+		uint64_t bitBuffer = 0;
+		size_t bitCount = 0;
+		bool markerReached = false;
 
-		int Extend(int v, int n);
 		void AddBitsBuffer();
-		void ReadBitBuffer();
+		void AddBitsStuffed();
+		int PeekBits(size_t amount) const;
+		void SkipBits(size_t amount);
+		uint8_t DecodeSymbol(const HuffmanTable& table);
 
 	public:
 		EntropyReader(ByteReader& br);
 
-		HuffmanResult FindCode(const std::string& code, HuffmanTree& root) const;
-		uint8_t NextSymbolFast(const HuffmanTree& tree);
-		std::pair<bool, uint8_t> NextSymbolFast(const std::array<int16_t, 1 << FAST_BITS>& table, const std::vector<HuffmanCode>& codes);
+		HuffmanValue DecodeValue(const HuffmanTable& table);
 		int ReadBitsBuffer(size_t amount);
+		int ReadBits(size_t amount);
+
+		/** @brief Discards the buffered bits and continues after the next restart marker. */
+		void Restart();
+
+		static int Extend(int v, int n);
+};
+
+/**
+ * @brief Canonical huffman table of a deflate block.
+ *
+ * @details
+ * Codes of up to INFLATE_FAST_BITS bits are resolved with a single lookup of the bit reversed
+ * lookahead, entries hold the symbol shifted left by 4 and the code length. Longer codes are
+ * decoded bit by bit from the code counts.
+ */
+struct InflateTable
+{
+	std::array<uint16_t, 1 << INFLATE_FAST_BITS> lookup{};
+	std::array<uint16_t, 16> counts{};
+	std::array<uint16_t, 288> symbols{};
+};
+
+/**
+ * @brief Decompresses a zlib stream.
+ *
+ * @details
+ * Bits are kept LSB first in a 64-bit accumulator that is refilled eight bytes at a time.
+ * Output goes into a buffer of known size, as PNG gives the size of the inflated data up front.
+ */
+class Inflater
+{
+	private:
+		const uint8_t* position;
+		const uint8_t* end;
+		uint64_t bitBuffer = 0;
+		size_t bitCount = 0;
+		size_t padding = 0; /**< @brief Zero bytes added after the end of the data. */
+
+		void Refill();
+		uint32_t ReadBits(size_t amount);
+		uint32_t DecodeSymbol(const InflateTable& table);
+		void ReadDynamicTables(InflateTable& lengths, InflateTable& distances);
+		uint8_t* InflateBlock(uint8_t* output, uint8_t* outputStart, uint8_t* outputEnd, const InflateTable& lengths, const InflateTable& distances);
+
+	public:
+		Inflater(const uint8_t* data, size_t size);
+
+		/**
+		 * @brief Inflates the whole stream.
+		 * @param output Buffer receiving the data.
+		 * @param size Expected size of the inflated data.
+		 */
+		void Inflate(uint8_t* output, size_t size);
+
+		static void BuildTable(const uint8_t* lengths, size_t count, InflateTable& table);
+};
+
+/** @brief Byte range of a mapped file that holds a glTF buffer. */
+struct ModelBuffer
+{
+	std::shared_ptr<const FileView> file;
+	size_t offset = 0;
+	size_t size = 0;
+
+	const uint8_t* GetData() const { return (file->GetData() + offset); }
 };
 
 /**
  * @brief A class for parsing and loading models.
+ *
+ * @details
+ * A glTF file is parsed and its buffers are mapped once. Loaders for the other meshes of the
+ * file are made with @ref GetMesh() or @ref GetMeshes(), which share the parsed tables and the
+ * mappings instead of reading the file again.
+ *
+ * Binary .glb files are mapped whole, their JSON chunk is parsed in place and their BIN chunk
+ * is used as the first buffer without being copied.
  */
 class ModelLoader
 {
 	private:
 		ModelInfo info{};
+		std::shared_ptr<const GltfInfo> gltf; /**< @brief Parsed tables, shared between copies of the loader. */
+		std::shared_ptr<std::vector<ModelBuffer>> buffers; /**< @brief Mapped buffers, shared between copies of the loader. */
 
-		std::string GetPart(const std::string& content, const std::string& target, const std::pair<char, char>& pair);
-		std::vector<std::string> GetList(const std::string& content, const std::string& target, const std::pair<char, char>& pair);
-		AttributeInfo GetAttribute(const std::string& accessContent, const std::string& viewContent) const;
-		std::string GetValue(const std::string& content, const std::string& target)  const;
+		AttributeInfo GetAttribute(size_t accessor) const;
 		void GetObjInfo(const std::string& name, size_t meshID);
 		void GetGltfInfo(const std::string& name, size_t meshID);
+		void GetGlbInfo(const std::string& name, size_t meshID);
+		void MapBuffers(const std::string& name, const ModelBuffer& binary);
+		void GetPrimitiveInfo(size_t meshID);
 
 	public:
 		ModelLoader(const std::string& name, const ModelType& type, size_t meshID = 0);
 		~ModelLoader();
 
+		/** @brief Number of meshes in the file, counting every primitive as a mesh. */
+		size_t MeshCount() const;
+
+		/**
+		 * @brief Makes a loader for another mesh of the same file without reading it again.
+		 * @param meshID Index of the mesh.
+		 * @return Loader sharing the parsed tables and buffer mappings.
+		 */
+		ModelLoader GetMesh(size_t meshID) const;
+
+		/** @brief Makes loaders for every mesh of the file, in mesh ID order. */
+		std::vector<ModelLoader> GetMeshes() const;
+
+		/**
+		 * @brief Builds the typed tables of a glTF file in a single pass over its JSON.
+		 * @param json Contents of the .gltf file.
+		 * @return Accessor, view, buffer, mesh and node tables.
+		 */
+		static GltfInfo ParseGltf(std::string_view json);
+
 		const ModelInfo& GetInfo() const;
 		void GetBytes(char* address, const AttributeType& type);
+
+		/**
+		 * @brief Gets the bytes of an attribute inside its mapped buffer without copying them.
+		 * @param type Attribute to get.
+		 * @return Start of the attribute, Length() bytes long and valid while a loader of the file exists.
+		 */
+		const uint8_t* GetData(const AttributeType& type) const;
+
+		/**
+		 * @brief Reads an attribute as floats in a single pass, whatever its layout in the file.
+		 *
+		 * @details
+		 * Follows the stride of interleaved views and converts integer components, normalizing them
+		 * if the accessor says so, which lets vertices be filled directly from quantized meshes.
+		 *
+		 * @param type Attribute to read.
+		 * @param destination First float of the first element.
+		 * @param components Floats to write per element, components the attribute does not have are left as they are.
+		 * @param stride Bytes between the starts of two elements in the destination.
+		 */
+		void ReadFloats(const AttributeType& type, float* destination, size_t components, size_t stride) const;
+
+		/** @brief Reads the indices, converting them from whatever integer type the file uses, throws if one does not fit the destination. */
+		void ReadIndices(uint16_t* destination) const;
+		void ReadIndices(uint32_t* destination) const;
 };
 
 /**
@@ -270,37 +590,71 @@ class ImageLoader
 {
 	private:
 		ImageInfo info{};
-		ImageData data{};
+		mutable ImageData data{};
+		FileView file{};
+
+		ImageLoaderConfig config{};
+		mutable std::once_flag decodeFlag;
 
 		void GetJpgInfo(const std::string& name);
-		void BuildHuffmanTree(std::string current, HuffmanTree& start, std::vector<HuffmanCode>& codes);
-		std::array<int16_t, 1 << FAST_BITS> BuildFastHuffmanTable(std::vector<HuffmanCode>& codes);
-		uint8_t NextEntropySymbol(EntropyReader& er, size_t tableIndex);
+		void GetKtx2Info(const std::string& name);
+		void GetPngInfo(const std::string& name);
+		void DecodePngData() const;
+		void PrepareData() const;
+		void DecodeEntropyData() const;
+		void BuildHuffmanTable(const std::vector<HuffmanCode>& codes, HuffmanTable& table) const;
 		DataBlock IDCTBlock(const DataBlock& input);
 
+		/** @brief Compresses block rows startRow to endRow of an RGBA8 image into their place in output. */
+		void CompressBlockRows(unsigned char* output, const unsigned char* pixels, Point<int, 2> wh, CompressionType compressionType, size_t startRow, size_t endRow) const;
+
 	public:
-		ImageLoader(const std::string& name, const ImageType& type);
+		ImageLoader(const std::string& name, const ImageType& type, const ImageLoaderConfig& loaderConfig = ImageLoaderConfig{});
 		~ImageLoader();
 
 		const ImageInfo& GetInfo() const;
+		const ImageLoaderConfig& GetConfig() const;
+		size_t GetChannels() const;
+		size_t GetWidth() const;
+		size_t GetHeight() const;
+
+		/** @brief Returns the mapped source file. */
+		const FileView& GetFile() const;
+
+		/** @brief Returns the format of stored levels, undefined for images that are decoded. */
+		VkFormat GetFormat() const;
 
-		void LoadEntropyData();
-		//void LoadBlock(std::array<unsigned char, (16 * 16) * 4>& buffer, size_t offset) const;
-		void LoadBlock(std::vector<unsigned char>& buffer, size_t offset) const;
-		//void LoadBlockGreyscale(std::array<unsigned char, (8 * 8)>& buffer, size_t offset) const;
-		void LoadBlockGreyscale(std::vector<unsigned char>& buffer, size_t offset) const;
+		/** @brief Returns the mip levels stored in a container, ready to be uploaded without decoding. */
+		const std::vector<MipLevelView>& GetLevels() const;
+
+		/** @brief Decodes the compressed image data, only the first call does any work. */
+		void LoadEntropyData() const;
 		void LoadPixels(std::vector<unsigned char>& buffer) const;
 		void LoadPixelsGreyscale(std::vector<unsigned char>& buffer) const;
 
 		void LoadPixelsThreaded(std::vector<unsigned char>& buffer) const;
+
+		/**
+		 * @brief Decodes the image one MCU row at a time, keeping only a few rows of blocks in memory.
+		 * @param callback Called with every band of finished rows, in top to bottom order.
+		 */
+		void StreamPixels(const PixelRowCallback& callback) const;
 		void LoadCompressedPixels(std::vector<unsigned char>& buffer, unsigned char* pixels, Point<int, 2> wh, CompressionType compressionType) const;
 		std::vector<MipLevel> LoadMipmaps(size_t mipLevels, bool srgb) const;
 		std::vector<MipLevel> LoadCompressedMipmaps(size_t mipLevels, bool srgb, CompressionType compressionType) const;
 
-		static DataBlock FIDCTBlock(const DataBlock& input);
+		static void FIDCTBlock(DataBlock& block, const QuantizationTable& quantization, size_t end = 63);
 		static void TransformBlocks(ImageData* data, size_t start, size_t end);
 
 		static std::vector<ImageLoader*> LoadImages(const std::vector<std::pair<std::string, ImageType>>& images);
+
+		/**
+		 * @brief Writes a mip chain to a KTX2 file.
+		 * @param path Path of the file.
+		 * @param levels Mip levels from largest to smallest, pixels or blocks matching the format.
+		 * @param format R8G8B8A8, BC1, BC3, BC4, BC5 or BC7 format of the levels.
+		 */
+		static void SaveKtx2(const std::string& path, const std::vector<MipLevel>& levels, VkFormat format);
 };
 
 std::ostream& operator<<(std::ostream& out, const ImageInfo& info);
\ No newline at end of file
@@ -60,6 +60,9 @@ class Matrix
 		 */
 		Matrix(const std::array<T, R * C>& init);
 
+		/** @brief Copy constructor (same type). */
+		Matrix(const Matrix<R, C, T>& other) = default;
+
 		/**
 		 * @brief Constructs a matrix by casting from another type.
 		 * @tparam CT Element type of the other matrix.
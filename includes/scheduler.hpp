@@ -0,0 +1,129 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+/**
+ * @file scheduler.hpp
+ * @brief Shared work stealing task scheduler.
+ *
+ * @details
+ * Provides a static scheduler that owns a fixed set of worker threads shared by every
+ * system that needs parallel work, so that nested and concurrent users never
+ * oversubscribe the machine. Tasks are submitted into a @ref TaskGroup that can be
+ * waited on; waiting threads execute queued tasks instead of blocking.
+ */
+
+/**
+ * @brief Set of submitted tasks that is waited on as a whole.
+ *
+ * @details
+ * Keeps count of the unfinished tasks and the first exception thrown by one of them,
+ * which is rethrown by @ref Scheduler::Wait().
+ */
+class TaskGroup
+{
+	friend class Scheduler;
+
+	private:
+		std::atomic<size_t> remaining = 0;
+		std::mutex exceptionMutex;
+		std::exception_ptr exception = nullptr;
+
+	public:
+		TaskGroup();
+		~TaskGroup();
+
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		/** @brief Returns true once every task submitted to the group has finished. */
+		bool Finished() const;
+};
+
+/**
+ * @brief Static work stealing scheduler.
+ *
+ * @details
+ * Every worker owns a task queue. Workers take their newest task first and steal the
+ * oldest task of another queue when their own is empty. Tasks submitted from outside
+ * the pool are spread over the queues.
+ *
+ * Typical usage:
+ * - Optionally call @ref Create() to choose the worker count, otherwise it is created on first use.
+ * - Submit tasks with @ref Submit() and wait for them with @ref Wait().
+ * - Split loops over ranges with @ref ParallelFor().
+ */
+class Scheduler
+{
+	private:
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		struct Pool
+		{
+			std::vector<std::thread> workers;
+			std::vector<std::unique_ptr<Queue>> queues;
+			std::mutex sleepMutex;
+			std::condition_variable sleepCondition;
+			std::atomic<size_t> queued = 0;
+			std::atomic<size_t> nextQueue = 0;
+			bool stopping = false;
+
+			~Pool();
+		};
+
+		static std::unique_ptr<Pool> pool;
+		static std::once_flag poolFlag;
+		static thread_local size_t workerIndex;
+
+		static Pool& GetPool();
+		static void Work(Pool& current, size_t index);
+		static bool RunTask(Pool& current, size_t index);
+
+	public:
+		/**
+		 * @brief Starts the worker threads.
+		 * @param threadCount Number of workers, 0 uses one less than the hardware concurrency.
+		 * @note Has no effect once the scheduler exists.
+		 */
+		static void Create(size_t threadCount = 0);
+
+		/** @brief Finishes the queued tasks and joins the workers, the scheduler can not be used afterwards. */
+		static void Destroy();
+
+		/**
+		 * @brief Queues a task as part of a group.
+		 * @param group Group the task counts towards.
+		 * @param task Function to execute on a worker.
+		 */
+		static void Submit(TaskGroup& group, std::function<void()> task);
+
+		/**
+		 * @brief Executes queued tasks until every task of the group has finished.
+		 * @param group Group to wait on.
+		 * @note Rethrows the first exception thrown by a task of the group.
+		 */
+		static void Wait(TaskGroup& group);
+
+		/**
+		 * @brief Splits [0, count) into ranges of at most grain elements and runs them in parallel.
+		 * @param count Number of elements.
+		 * @param grain Maximum number of elements per task.
+		 * @param body Function called with the start and end of every range.
+		 */
+		static void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+		/** @brief Returns the number of threads that execute tasks, including the waiting thread. */
+		static size_t GetThreadCount();
+};
@@ -32,6 +32,7 @@ struct ShapeSettings
 	bool scalarized = true;
 	Point<int, 2> resolution = {1, 1}; 
 	uint32_t lod = 0;
+	bool instanced = false; /**< @brief Load only the loader's model mesh, unscalarized and in its own space, to be drawn once per transform in ModelInfo::instances. */
 };
 
 /**
@@ -72,6 +73,9 @@ class Shape
 
 		void CreateLeaf();
 
+		/** @brief Loads the vertices and indices of a single mesh of a model. */
+		void CreateModel(ModelLoader loader);
+
 	public:
 		/** @brief Constructs an empty shape (no vertices/indices). */
 		Shape();
@@ -126,6 +130,12 @@ class Shape
 		 */
 		void Move(const point3D& translation);
 
+		/**
+		 * @brief Transforms all vertices by a matrix.
+		 * @param transform Matrix applied to positions, normals use its inverse transpose.
+		 */
+		void Transform(const mat4& transform);
+
 		/**
 		 * @brief Rotates all vertices around an axis.
 		 * @param degrees Angle in degrees.
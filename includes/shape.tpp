@@ -50,44 +50,71 @@ void Shape<V, I>::Create(ModelLoader loader, ShapeSettings shapeSettings)
 
 	settings = shapeSettings;
 
-	const ModelInfo& info = loader.GetInfo();
-	vertices.resize(info.size);
+	// Instanced meshes are not scalarized, that would move them away from their instance transforms.
+	if (settings.instanced)
+	{
+		CreateModel(loader);
+		return;
+	}
 
-	if constexpr (hasPosition)
+	// The following meshes reuse the parsed file, each is read once and placed at every node that draws it.
+	for (size_t i = loader.GetInfo().ID; i < loader.MeshCount(); i++)
 	{
-		if (Bitmask::HasFlag(info.vertexConfig, Position))
-		{
-			std::vector<point3D> positions(info.GetAttribute(AttributeType::Position).Count());
-			loader.GetBytes(reinterpret_cast<char*>(positions.data()), AttributeType::Position);
+		ModelLoader mesh = (i == loader.GetInfo().ID ? loader : loader.GetMesh(i));
 
-			point3D offset = info.GetAttribute(AttributeType::Position).Translation();
+		Shape<V, I> part;
+		part.CreateModel(mesh);
 
-			size_t i = 0;
-			for (const point3D& point : positions) { vertices[i++].position = point + offset; }
+		for (const mat4& instance : mesh.GetInfo().instances)
+		{
+			Shape<V, I> placed = part;
+			placed.Transform(instance);
+			Join(placed);
 		}
 	}
 
-	if constexpr (hasNormal)
+	if (settings.scalarized) Scalarize();
+}
+
+SHAPE_TEMPLATE
+void Shape<V, I>::CreateModel(ModelLoader loader)
+{
+	const ModelInfo& info = loader.GetInfo();
+	vertices.resize(info.size);
+
+	// Attributes are converted from the mapped buffers straight into the vertices, whatever their layout in the file.
+	if (!vertices.empty())
 	{
-		if (Bitmask::HasFlag(info.vertexConfig, Normal))
+		if constexpr (hasPosition)
 		{
-			std::vector<point3D> normals(info.GetAttribute(AttributeType::Normal).Count());
-			loader.GetBytes(reinterpret_cast<char*>(normals.data()), AttributeType::Normal);
+			if (Bitmask::HasFlag(info.vertexConfig, Position))
+			{
+				loader.ReadFloats(AttributeType::Position, &vertices[0].position.x(), 3, sizeof(Vertex<V>));
+			}
+		}
 
-			size_t i = 0;
-			for (const point3D& point : normals) { vertices[i++].normal = point; }
+		if constexpr (hasNormal)
+		{
+			if (Bitmask::HasFlag(info.vertexConfig, Normal))
+			{
+				loader.ReadFloats(AttributeType::Normal, &vertices[0].normal.x(), 3, sizeof(Vertex<V>));
+			}
 		}
-	}
 
-	if constexpr (hasCoordinate)
-	{
-		if (Bitmask::HasFlag(info.vertexConfig, Coordinate))
+		if constexpr (hasCoordinate)
 		{
-			std::vector<point2D> coordinates(info.GetAttribute(AttributeType::Coordinate).Count());
-			loader.GetBytes(reinterpret_cast<char*>(coordinates.data()), AttributeType::Coordinate);
+			if (Bitmask::HasFlag(info.vertexConfig, Coordinate))
+			{
+				loader.ReadFloats(AttributeType::Coordinate, &vertices[0].coordinate.x(), 2, sizeof(Vertex<V>));
+			}
+		}
 
-			size_t i = 0;
-			for (const point2D& point : coordinates) { vertices[i++].coordinate = point; }
+		if constexpr (hasColor)
+		{
+			if (Bitmask::HasFlag(info.vertexConfig, Color))
+			{
+				loader.ReadFloats(AttributeType::Color, &vertices[0].color.x(), 3, sizeof(Vertex<V>));
+			}
 		}
 	}
 
@@ -96,21 +123,9 @@ void Shape<V, I>::Create(ModelLoader loader, ShapeSettings shapeSettings)
 		if (info.indexConfig != VK_INDEX_TYPE_NONE_KHR)
 		{
 			indices.resize(info.GetAttribute(AttributeType::Index).Count());
-			std::vector<uint16_t> tempIndices(info.GetAttribute(AttributeType::Index).Count());
-			loader.GetBytes(reinterpret_cast<char*>(tempIndices.data()), AttributeType::Index);
-
-			size_t i = 0;
-			for (const uint16_t& index : tempIndices) { indices[i++] = static_cast<indexType>(index); }
+			if (!indices.empty()) loader.ReadIndices(indices.data());
 		}
 	}
-
-	if (info.count > 0)
-	{
-		Shape<V, I> other(ModelLoader(info.name, info.type, info.ID + 1), {false, 1});
-		Join(other);
-	}
-
-	if (settings.scalarized) Scalarize();
 }
 
 SHAPE_TEMPLATE
@@ -434,6 +449,36 @@ void Shape<V, I>::Move(const point3D& translation)
 	}
 }
 
+SHAPE_TEMPLATE
+void Shape<V, I>::Transform(const mat4& transform)
+{
+	if constexpr (hasPosition)
+	{
+		for (Vertex<V>& vertex : vertices)
+		{
+			const point4D position = transform * point4D(vertex.position, 1.0f);
+			vertex.position = point3D(position.x(), position.y(), position.z());
+		}
+	}
+
+	if constexpr (hasNormal)
+	{
+		// Multiplying by the transposed inverse keeps normals perpendicular under non-uniform scale.
+		const mat4 inverse = mat4(transform).Inversed();
+
+		for (Vertex<V>& vertex : vertices)
+		{
+			point3D normal;
+			for (size_t r = 0; r < 3; r++)
+			{
+				for (size_t c = 0; c < 3; c++) { normal[r] += inverse(c, r) * vertex.normal[c]; }
+			}
+
+			if (normal.Length() > 0.0f) vertex.normal = normal.Unitized();
+		}
+	}
+}
+
 SHAPE_TEMPLATE
 void Shape<V, I>::Rotate(const float& degrees, const Axis& axis)
 {
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <type_traits>
 #include <filesystem>
@@ -73,7 +74,7 @@ class Utilities
 		 * @param pair Pair of characters (open, close).
 		 * @return Index pair (open position, close position).
 		 */
-		static std::pair<size_t, size_t> FindPair(const std::string& string, size_t start, const std::pair<char, char>& pair);
+		static std::pair<size_t, size_t> FindPair(std::string_view string, size_t start, const std::pair<char, char>& pair);
 		
 		/**
 		 * @brief Converts a byte/integral value to a string of bits.
@@ -93,6 +93,21 @@ FetchShaderCompilers ()
 	fi
 }
 
+FetchShaders ()
+{
+	if [[ $override == 1 ]]; then
+		rm -f $path/shaders/mipmap.comp
+	fi
+
+	if ! test -f $path/shaders/mipmap.comp; then
+		echo "FETCHING LIBRARY SHADERS"
+		cd $path/shaders
+		FetchFile ${fetch}shaders/mipmap.comp
+		cd $path
+		echo "LIBRARY SHADERS FETCHED"
+	fi
+}
+
 CleanDirectories ()
 {
 	echo "DELETING SOURCE DIRECTORIES"
@@ -122,6 +137,8 @@ ExecuteCommand ()
 		FetchCMakeFile
 	elif [[ $1 == "shdrcmp" ]] || [[ $1 == "g" ]]; then
 		FetchShaderCompilers
+	elif [[ $1 == "shdr" ]] || [[ $1 == "h" ]]; then
+		FetchShaders
 	fi
 }
 
@@ -171,4 +188,5 @@ if test $commandCount == 0; then
 	ExecuteCommand s
 	ExecuteCommand c
 	ExecuteCommand g
+	ExecuteCommand h
 fi
\ No newline at end of file
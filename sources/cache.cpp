@@ -0,0 +1,224 @@
+#include "cache.hpp"
+
+#include "utilities.hpp"
+
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <system_error>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+
+#define CACHE_MAGIC 0x5854434Cu
+#define CACHE_VERSION 2u
+#define CACHE_ALIGNMENT 16
+
+struct CacheHeader
+{
+	uint32_t magic = CACHE_MAGIC;
+	uint32_t version = CACHE_VERSION;
+	uint32_t levelCount = 0;
+	uint32_t reserved = 0;
+	uint64_t key = 0;
+};
+
+struct CacheLevelHeader
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	uint64_t varianceOffset = 0;
+	uint64_t varianceSize = 0;
+};
+
+void TextureCache::SetDirectory(const std::string& path)
+{
+	directory = path;
+}
+
+std::string TextureCache::GetDirectory()
+{
+	if (directory.empty()) return (Utilities::GetPath() + "/cache");
+
+	return (directory);
+}
+
+std::string TextureCache::GetFilePath(uint64_t key)
+{
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+
+	return (GetDirectory() + "/" + name + ".tex");
+}
+
+static uint64_t MixHash(uint64_t value)
+{
+	value ^= value >> 33;
+	value *= 0xFF51AFD7ED558CCDull;
+	value ^= value >> 33;
+	value *= 0xC4CEB9FE1A85EC53ull;
+	value ^= value >> 33;
+
+	return (value);
+}
+
+uint64_t TextureCache::Hash(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	// Four independent lanes keep the multiplies of neighbouring words from waiting on each other.
+	uint64_t lanes[4] = {seed ^ 0x9E3779B97F4A7C15ull, seed + size, ~seed, seed * 0x2545F4914F6CDD1Dull};
+	size_t i = 0;
+
+	for (; i + 32 <= size; i += 32)
+	{
+		for (size_t j = 0; j < 4; j++)
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes + i + j * 8, 8);
+			lanes[j] = (lanes[j] ^ (word * 0x87C37B91114253D5ull)) * 0x4CF5AD432745937Full;
+			lanes[j] = (lanes[j] << 31) | (lanes[j] >> 33);
+		}
+	}
+
+	uint64_t hash = MixHash(lanes[0]) ^ MixHash(lanes[1] + 1) ^ MixHash(lanes[2] + 2) ^ MixHash(lanes[3] + 3);
+
+	for (; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+	}
+
+	return (MixHash(hash ^ size));
+}
+
+bool TextureCache::Load(uint64_t key, CachedTexture& texture)
+{
+	const std::string path = GetFilePath(key);
+
+	std::error_code error;
+	if (!std::filesystem::exists(path, error)) return (false);
+
+	try
+	{
+		texture.file = FileView(path, FileAccess::Sequential);
+	}
+	catch (const std::exception&)
+	{
+		return (false);
+	}
+
+	const uint8_t* data = texture.file.GetData();
+	const size_t size = texture.file.GetSize();
+
+	CacheHeader header{};
+	if (size < sizeof(header)) return (false);
+	std::memcpy(&header, data, sizeof(header));
+
+	if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.key != key) return (false);
+	if (sizeof(header) + header.levelCount * sizeof(CacheLevelHeader) > size) return (false);
+
+	texture.levels.resize(header.levelCount);
+
+	for (size_t i = 0; i < header.levelCount; i++)
+	{
+		CacheLevelHeader levelHeader{};
+		std::memcpy(&levelHeader, data + sizeof(header) + i * sizeof(levelHeader), sizeof(levelHeader));
+
+		if (levelHeader.offset > size || levelHeader.size > size - levelHeader.offset ||
+			levelHeader.varianceOffset > size || levelHeader.varianceSize > size - levelHeader.varianceOffset)
+		{
+			texture.levels.clear();
+			return (false);
+		}
+
+		texture.levels[i].width = levelHeader.width;
+		texture.levels[i].height = levelHeader.height;
+		texture.levels[i].level = i;
+		texture.levels[i].pixels = data + levelHeader.offset;
+		texture.levels[i].size = levelHeader.size;
+		texture.levels[i].variance = (levelHeader.varianceSize ? data + levelHeader.varianceOffset : nullptr);
+		texture.levels[i].varianceSize = levelHeader.varianceSize;
+	}
+
+	return (true);
+}
+
+bool TextureCache::Store(uint64_t key, const std::vector<MipLevel>& levels)
+{
+	std::error_code error;
+	std::filesystem::create_directories(GetDirectory(), error);
+	if (error) return (false);
+
+	CacheHeader header{};
+	header.levelCount = static_cast<uint32_t>(levels.size());
+	header.key = key;
+
+	std::vector<CacheLevelHeader> levelHeaders(levels.size());
+	uint64_t offset = sizeof(header) + levels.size() * sizeof(CacheLevelHeader);
+
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		offset = (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+
+		levelHeaders[i].width = static_cast<uint32_t>(levels[i].width);
+		levelHeaders[i].height = static_cast<uint32_t>(levels[i].height);
+		levelHeaders[i].offset = offset;
+		levelHeaders[i].size = levels[i].pixels.size();
+
+		offset += levels[i].pixels.size();
+
+		if (levels[i].variance.empty()) continue;
+
+		offset = (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+		levelHeaders[i].varianceOffset = offset;
+		levelHeaders[i].varianceSize = levels[i].variance.size();
+
+		offset += levels[i].variance.size();
+	}
+
+	const std::string path = GetFilePath(key);
+	const uint64_t writer = std::hash<std::thread::id>{}(std::this_thread::get_id()) ^ std::chrono::steady_clock::now().time_since_epoch().count();
+	const std::string temporaryPath = path + "." + std::to_string(writer) + ".tmp";
+
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return (false);
+
+		const char padding[CACHE_ALIGNMENT]{};
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(levelHeaders.data()), levelHeaders.size() * sizeof(CacheLevelHeader));
+
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			file.write(padding, levelHeaders[i].offset - static_cast<uint64_t>(file.tellp()));
+			file.write(reinterpret_cast<const char*>(levels[i].pixels.data()), levels[i].pixels.size());
+
+			if (levels[i].variance.empty()) continue;
+
+			file.write(padding, levelHeaders[i].varianceOffset - static_cast<uint64_t>(file.tellp()));
+			file.write(reinterpret_cast<const char*>(levels[i].variance.data()), levels[i].variance.size());
+		}
+
+		if (!file.good())
+		{
+			file.close();
+			std::filesystem::remove(temporaryPath, error);
+			return (false);
+		}
+	}
+
+	std::filesystem::rename(temporaryPath, path, error);
+
+	if (error)
+	{
+		std::filesystem::remove(temporaryPath, error);
+		return (false);
+	}
+
+	return (true);
+}
+
+std::string TextureCache::directory = "";
@@ -70,6 +70,7 @@ void Device::CreateLogical()
 	if (config.depthBounds) {deviceFeaturesBase.depthBounds = VK_TRUE;}
 	if (config.compressionBC) {deviceFeaturesBase.textureCompressionBC = VK_TRUE;}
 	if (config.multiDrawIndirect) {deviceFeaturesBase.multiDrawIndirect = VK_TRUE;}
+	if (config.storageWriteWithoutFormat) {deviceFeaturesBase.shaderStorageImageWriteWithoutFormat = VK_TRUE;}
 
 	VkPhysicalDeviceVulkan13Features deviceFeatures3{};
 	deviceFeatures3.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
@@ -165,6 +166,11 @@ const bool Device::Created() const
 	return (physicalDevice != nullptr && logicalDevice != nullptr);
 }
 
+const DeviceConfig& Device::GetConfig() const
+{
+	return (config);
+}
+
 VkPhysicalDevice& Device::GetPhysicalDevice()
 {
 	if (!physicalDevice) throw (std::runtime_error("Physical device requested but not yet created"));
@@ -277,6 +283,7 @@ DeviceInfo Device::GetBestDevice(DeviceConfig& config)
 		else if (config.depthBounds && !availableDevices[i].deviceFeatures.features.depthBounds) {continue;}
 		else if (config.compressionBC && !availableDevices[i].deviceFeatures.features.textureCompressionBC) {continue;}
 		else if (config.multiDrawIndirect && !availableDevices[i].deviceFeatures.features.multiDrawIndirect) {continue;}
+		else if (config.storageWriteWithoutFormat && !availableDevices[i].deviceFeatures.features.shaderStorageImageWriteWithoutFormat) {continue;}
 		else if (config.nonUniformIndexingShaderSampledImageArray && !availableDevices[i].deviceFeatures2.shaderSampledImageArrayNonUniformIndexing) {continue;}
 		else if (config.synchronization2 && !availableDevices[i].deviceFeatures3.synchronization2) {continue;}
 
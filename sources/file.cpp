@@ -0,0 +1,176 @@
+#include "file.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+FileView::FileView()
+{
+
+}
+
+FileView::FileView(const std::string& path, FileAccess access)
+{
+#ifdef _WIN32
+	DWORD flags = (access == FileAccess::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS);
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE) throw (std::runtime_error("Failed to open file: " + path));
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize{};
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		Close();
+		throw (std::runtime_error("Failed to get size of file: " + path));
+	}
+
+	size = static_cast<size_t>(fileSize.QuadPart);
+	if (size == 0) return;
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle) data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+	if (!data)
+	{
+		Close();
+		throw (std::runtime_error("Failed to map file: " + path));
+	}
+#else
+	descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (descriptor < 0) throw (std::runtime_error("Failed to open file: " + path));
+
+	struct stat status{};
+	if (fstat(descriptor, &status) != 0)
+	{
+		Close();
+		throw (std::runtime_error("Failed to get size of file: " + path));
+	}
+
+	size = static_cast<size_t>(status.st_size);
+	if (size == 0) return;
+
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+	if (mapping == MAP_FAILED)
+	{
+		size = 0;
+		Close();
+		throw (std::runtime_error("Failed to map file: " + path));
+	}
+
+	data = static_cast<const uint8_t*>(mapping);
+
+	// The mapping keeps its own reference to the file.
+	close(descriptor);
+	descriptor = -1;
+
+	Advise(access);
+#endif
+}
+
+FileView::~FileView()
+{
+	Close();
+}
+
+FileView::FileView(FileView&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+FileView& FileView::operator=(FileView&& other) noexcept
+{
+	if (this == &other) return (*this);
+
+	Close();
+
+	data = std::exchange(other.data, nullptr);
+	size = std::exchange(other.size, 0);
+#ifdef _WIN32
+	fileHandle = std::exchange(other.fileHandle, nullptr);
+	mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#else
+	descriptor = std::exchange(other.descriptor, -1);
+#endif
+
+	return (*this);
+}
+
+void FileView::Close()
+{
+#ifdef _WIN32
+	if (data) UnmapViewOfFile(data);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (fileHandle) CloseHandle(fileHandle);
+
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+#else
+	if (data) munmap(const_cast<uint8_t*>(data), size);
+	if (descriptor >= 0) close(descriptor);
+
+	descriptor = -1;
+#endif
+
+	data = nullptr;
+	size = 0;
+}
+
+void FileView::Advise(FileAccess access, size_t offset, size_t length) const
+{
+#ifndef _WIN32
+	if (!data || offset >= size) return;
+
+	// madvise needs a page aligned start, so the range is widened down to the page containing offset.
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t start = offset / pageSize * pageSize;
+	const size_t end = offset + std::min(length, size - offset);
+
+	madvise(const_cast<uint8_t*>(data) + start, end - start, (access == FileAccess::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM));
+#endif
+}
+
+void FileView::Prefetch(size_t offset, size_t length) const
+{
+	if (!data || offset >= size) return;
+
+	length = std::min(length, size - offset);
+
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range{ const_cast<uint8_t*>(data) + offset, length };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t start = offset / pageSize * pageSize;
+
+	madvise(const_cast<uint8_t*>(data) + start, offset + length - start, MADV_WILLNEED);
+#endif
+}
+
+const uint8_t* FileView::GetData() const
+{
+	return (data);
+}
+
+size_t FileView::GetSize() const
+{
+	return (size);
+}
+
+std::string_view FileView::GetString() const
+{
+	return (std::string_view(reinterpret_cast<const char*>(data), size));
+}
@@ -4,8 +4,63 @@
 #include "bitmask.hpp"
 #include "command.hpp"
 #include "buffer.hpp"
+#include "cache.hpp"
+#include "pipeline.hpp"
+#include "descriptor.hpp"
+#include "utilities.hpp"
 
 #include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+// Levels written by one dispatch of the mipmap shader, the first from the source level and the rest in shared memory.
+#define MIPMAP_DISPATCH_LEVELS 5
+#define MIPMAP_TILE 16
+
+struct MipmapParameters
+{
+	int32_t sourceLevel = 0;
+	int32_t levelCount = 0;
+	int32_t srgb = 0;
+};
+
+static Pipeline mipmapPipeline;
+static Descriptor mipmapDescriptor;
+static Device* mipmapDevice = nullptr;
+
+// Storage images cannot be sRGB, those levels are written through a UNORM view and encoded by the shader.
+static VkFormat GetStorageFormat(VkFormat format)
+{
+	switch (format)
+	{
+		case VK_FORMAT_R8_SRGB: return (VK_FORMAT_R8_UNORM);
+		case VK_FORMAT_R8G8_SRGB: return (VK_FORMAT_R8G8_UNORM);
+		case VK_FORMAT_R8G8B8A8_SRGB: return (VK_FORMAT_R8G8B8A8_UNORM);
+		case VK_FORMAT_B8G8R8A8_SRGB: return (VK_FORMAT_B8G8R8A8_UNORM);
+		case VK_FORMAT_A8B8G8R8_SRGB_PACK32: return (VK_FORMAT_A8B8G8R8_UNORM_PACK32);
+		default: return (format);
+	}
+}
+
+static uint32_t LevelSize(uint32_t size, uint32_t level)
+{
+	return (std::max(size >> level, 1u));
+}
+
+// Bytes per texel of the uncompressed formats textures are loaded into, 0 for any other format.
+static size_t TexelBytes(VkFormat format)
+{
+	switch (format)
+	{
+		case VK_FORMAT_R8_UNORM: case VK_FORMAT_R8_SRGB: return (1);
+		case VK_FORMAT_R8G8_UNORM: case VK_FORMAT_R8G8_SRGB: case VK_FORMAT_R16_UNORM: return (2);
+		case VK_FORMAT_R8G8B8A8_UNORM: case VK_FORMAT_R8G8B8A8_SRGB: return (4);
+		case VK_FORMAT_B8G8R8A8_UNORM: case VK_FORMAT_B8G8R8A8_SRGB: return (4);
+		case VK_FORMAT_A8B8G8R8_UNORM_PACK32: case VK_FORMAT_A8B8G8R8_SRGB_PACK32: return (4);
+		default: return (0);
+	}
+}
 
 Image::Image()
 {
@@ -38,17 +93,38 @@ void Image::Create(const ImageLoader& imageLoader, const ImageConfig& imageConfi
 
 	if (!device) device = &Manager::GetDevice();
 
-	config.width = imageLoader.GetInfo().startOfFrameInfo.width;
-	config.height = imageLoader.GetInfo().startOfFrameInfo.height;
+	config.width = static_cast<uint32_t>(imageLoader.GetWidth());
+	config.height = static_cast<uint32_t>(imageLoader.GetHeight());
+
+	// Containers carry their own format and mip chain, which are uploaded as they are stored.
+	const std::vector<MipLevelView>& storedLevels = imageLoader.GetLevels();
+
+	if (!storedLevels.empty())
+	{
+		config.format = imageLoader.GetFormat();
+		config.viewConfig.format = config.format;
+		config.compressed = (config.format != VK_FORMAT_R8G8B8A8_UNORM && config.format != VK_FORMAT_R8G8B8A8_SRGB);
+		config.createMipmaps = (storedLevels.size() > 1 || (config.createMipmaps && !config.compressed));
+		config.mipLevels = 1;
+	}
 
 	if (config.createMipmaps)
 	{
-		config.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(config.width, config.height)))) + 1;
+		if (storedLevels.size() > 1) config.mipLevels = static_cast<uint32_t>(storedLevels.size());
+		else config.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(config.width, config.height)))) + 1;
 		config.targetLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 		config.usage = Bitmask::SetFlag(config.usage, VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 		config.usage = Bitmask::SetFlag(config.usage, VK_IMAGE_USAGE_TRANSFER_DST_BIT);
 		config.viewConfig.subresourceRange.levelCount = config.mipLevels;
 		config.samplerConfig.lodRange = point2D(0, VK_LOD_CLAMP_NONE);
+
+		if (config.computeMipmaps && !config.compressed && SupportsComputeMipmaps())
+		{
+			// sRGB views cannot be storage images, so only the level views created for the shader keep that usage.
+			if (GetStorageFormat(config.format) != config.format) config.viewConfig.usage = config.usage;
+			config.usage = Bitmask::SetFlag(config.usage, VK_IMAGE_USAGE_STORAGE_BIT);
+		}
+		else config.computeMipmaps = false;
 	}
 
 	CreateImage();
@@ -57,12 +133,24 @@ void Image::Create(const ImageLoader& imageLoader, const ImageConfig& imageConfi
 	CreateSampler();
 	TransitionLayout();
 
+	if (!storedLevels.empty())
+	{
+		UploadLevels(storedLevels);
+		return;
+	}
+
+	if (config.cached)
+	{
+		LoadCached(imageLoader);
+		return;
+	}
+
 	Load(imageLoader);
 
 	if (config.createMipmaps)
 	{
 		if (config.compressed) {CreateCompressedMipmaps(imageLoader);}
-		else {CreateMipmaps();}
+		else {GenerateMipmaps();}
 	}
 }
 
@@ -86,6 +174,9 @@ void Image::CreateImage()
 	createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	createInfo.initialLayout = config.currentLayout;
 
+	// Compute mipmaps write sRGB levels through views with a storage capable format.
+	if (config.computeMipmaps && GetStorageFormat(config.format) != config.format) createInfo.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+
 	if (vkCreateImage(device->GetLogicalDevice(), &createInfo, nullptr, &image) != VK_SUCCESS)
 		throw (std::runtime_error("Failed to create image"));
 }
@@ -168,6 +259,218 @@ void Image::CreateMipmaps()
 	config.targetLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 }
 
+bool Image::SupportsComputeMipmaps() const
+{
+	if (!device->GetConfig().storageWriteWithoutFormat) return (false);
+	if (!Bitmask::HasFlag(config.usage, VK_IMAGE_USAGE_SAMPLED_BIT)) return (false);
+	if (config.type != VK_IMAGE_TYPE_2D || config.arrayLayers != 1) return (false);
+
+	VkFormatProperties formatProperties{};
+	vkGetPhysicalDeviceFormatProperties(device->GetPhysicalDevice(), config.format, &formatProperties);
+	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) return (false);
+
+	VkFormatProperties storageProperties{};
+	vkGetPhysicalDeviceFormatProperties(device->GetPhysicalDevice(), GetStorageFormat(config.format), &storageProperties);
+
+	return (storageProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+}
+
+void Image::GenerateMipmaps()
+{
+	if (config.computeMipmaps) CreateComputeMipmaps();
+	else CreateMipmaps();
+}
+
+void Image::CreateComputeMipmaps()
+{
+	if (!image) throw (std::runtime_error("Image does not exist"));
+	if (!device) throw (std::runtime_error("Image has no device"));
+
+	if (mipmapDevice != device)
+	{
+		DestroyMipmapPipeline();
+
+		std::vector<DescriptorConfig> descriptorConfig(2);
+		descriptorConfig[0].type = DescriptorType::CombinedSampler;
+		descriptorConfig[0].stages = VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorConfig[1].type = DescriptorType::StorageImage;
+		descriptorConfig[1].stages = VK_SHADER_STAGE_COMPUTE_BIT;
+		descriptorConfig[1].count = MIPMAP_DISPATCH_LEVELS;
+		mipmapDescriptor.Create(0, descriptorConfig, device);
+
+		PipelineConfig pipelineConfig{};
+		pipelineConfig.type = PipelineType::Compute;
+		pipelineConfig.shader = "mipmap";
+		pipelineConfig.descriptorLayouts = {mipmapDescriptor.GetLayout()};
+		pipelineConfig.pushConstants = {{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MipmapParameters)}};
+		mipmapPipeline.Create(pipelineConfig, device);
+
+		mipmapDevice = device;
+	}
+
+	// A dispatch continues past a level in shared memory only while that level halves exactly, otherwise the next dispatch filters it from the image.
+	struct Dispatch
+	{
+		uint32_t sourceLevel = 0;
+		uint32_t levelCount = 0;
+	};
+
+	std::vector<Dispatch> dispatches;
+
+	for (uint32_t level = 0; level + 1 < config.mipLevels;)
+	{
+		uint32_t count = 1;
+
+		while (count < MIPMAP_DISPATCH_LEVELS && level + count + 1 < config.mipLevels)
+		{
+			const uint32_t width = LevelSize(config.width, level + count);
+			const uint32_t height = LevelSize(config.height, level + count);
+
+			if ((width > 1 && width % 2 != 0) || (height > 1 && height % 2 != 0)) break;
+			count++;
+		}
+
+		dispatches.push_back({level, count});
+		level += count;
+	}
+
+	const VkFormat storageFormat = GetStorageFormat(config.format);
+	std::vector<VkImageView> levelViews(config.mipLevels, nullptr);
+
+	for (uint32_t i = 1; i < config.mipLevels; i++)
+	{
+		ImageViewConfig levelConfig = config.viewConfig;
+		levelConfig.format = storageFormat;
+		levelConfig.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+		levelConfig.subresourceRange.baseMipLevel = i;
+		levelConfig.subresourceRange.levelCount = 1;
+		CreateView(levelViews[i], image, levelConfig, device);
+	}
+
+	// The sets only live for this submission, so they come from a pool of their own instead of the shared one.
+	VkDescriptorPoolSize poolSizes[] =
+	{
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, CUI(dispatches.size())},
+		{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, CUI(dispatches.size() * MIPMAP_DISPATCH_LEVELS)},
+	};
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = CUI(std::size(poolSizes));
+	poolInfo.pPoolSizes = poolSizes;
+	poolInfo.maxSets = CUI(dispatches.size());
+
+	VkDescriptorPool pool = nullptr;
+	if (vkCreateDescriptorPool(device->GetLogicalDevice(), &poolInfo, nullptr, &pool) != VK_SUCCESS)
+		throw (std::runtime_error("Failed to create mipmap descriptor pool"));
+
+	Command command;
+	CommandConfig commandConfig{};
+	commandConfig.queueIndex = device->GetQueueIndex(QueueType::Graphics);
+	command.Create(commandConfig, device);
+	command.Begin();
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange = config.viewConfig.subresourceRange;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = config.mipLevels;
+	barrier.oldLayout = config.currentLayout;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(command.GetBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	mipmapPipeline.Bind(command.GetBuffer());
+
+	for (const Dispatch& dispatch : dispatches)
+	{
+		VkDescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = pool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &mipmapDescriptor.GetLayout();
+
+		VkDescriptorSet set = nullptr;
+		if (vkAllocateDescriptorSets(device->GetLogicalDevice(), &allocateInfo, &set) != VK_SUCCESS)
+			throw (std::runtime_error("Failed to allocate mipmap descriptor set"));
+
+		VkDescriptorImageInfo sourceInfo{};
+		sourceInfo.sampler = sampler;
+		sourceInfo.imageView = view;
+		sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		// Unused slots repeat the last level so every descriptor in the array is valid.
+		VkDescriptorImageInfo levelInfos[MIPMAP_DISPATCH_LEVELS]{};
+		for (uint32_t i = 0; i < MIPMAP_DISPATCH_LEVELS; i++)
+		{
+			levelInfos[i].imageView = levelViews[dispatch.sourceLevel + 1 + std::min(i, dispatch.levelCount - 1)];
+			levelInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+
+		VkWriteDescriptorSet writeInfos[2]{};
+		writeInfos[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeInfos[0].dstSet = set;
+		writeInfos[0].dstBinding = 0;
+		writeInfos[0].descriptorCount = 1;
+		writeInfos[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeInfos[0].pImageInfo = &sourceInfo;
+		writeInfos[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeInfos[1].dstSet = set;
+		writeInfos[1].dstBinding = 1;
+		writeInfos[1].descriptorCount = MIPMAP_DISPATCH_LEVELS;
+		writeInfos[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writeInfos[1].pImageInfo = levelInfos;
+
+		vkUpdateDescriptorSets(device->GetLogicalDevice(), 2, writeInfos, 0, nullptr);
+		vkCmdBindDescriptorSets(command.GetBuffer(), VK_PIPELINE_BIND_POINT_COMPUTE, mipmapPipeline.GetLayout(), 0, 1, &set, 0, nullptr);
+
+		MipmapParameters parameters{};
+		parameters.sourceLevel = static_cast<int32_t>(dispatch.sourceLevel);
+		parameters.levelCount = static_cast<int32_t>(dispatch.levelCount);
+		parameters.srgb = (storageFormat != config.format);
+		vkCmdPushConstants(command.GetBuffer(), mipmapPipeline.GetLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(parameters), &parameters);
+
+		const uint32_t width = LevelSize(config.width, dispatch.sourceLevel + 1);
+		const uint32_t height = LevelSize(config.height, dispatch.sourceLevel + 1);
+		vkCmdDispatch(command.GetBuffer(), (width + MIPMAP_TILE - 1) / MIPMAP_TILE, (height + MIPMAP_TILE - 1) / MIPMAP_TILE, 1);
+
+		// The last level written is the source of the next dispatch.
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.subresourceRange.baseMipLevel = dispatch.sourceLevel + dispatch.levelCount;
+		barrier.subresourceRange.levelCount = 1;
+
+		vkCmdPipelineBarrier(command.GetBuffer(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = config.mipLevels;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(command.GetBuffer(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	command.End();
+	command.Submit();
+
+	vkDestroyDescriptorPool(device->GetLogicalDevice(), pool, nullptr);
+	for (VkImageView levelView : levelViews)
+	{
+		if (levelView) vkDestroyImageView(device->GetLogicalDevice(), levelView, nullptr);
+	}
+
+	config.currentLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	config.targetLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
 void Image::CreateCompressedMipmaps(const ImageLoader& imageLoader)
 {
 	if (!image) throw (std::runtime_error("Image does not exist"));
@@ -175,12 +478,18 @@ void Image::CreateCompressedMipmaps(const ImageLoader& imageLoader)
 
 	//if (!config.compressed || !config.createMipmaps) return;
 
-	std::vector<MipLevel> compressedMipmaps = imageLoader.LoadCompressedMipmaps(config.mipLevels, config.srgb, (config.normal ? CompressionType::BC5 : CompressionType::BC1));
+	std::vector<MipLevel> compressedMipmaps = imageLoader.LoadCompressedMipmaps(config.mipLevels, config.srgb, GetCompressionType());
 	for (int i = 0; i < config.mipLevels; i++)
 	{
 		Update(&compressedMipmaps[i].pixels[0], compressedMipmaps[i].pixels.size(), {compressedMipmaps[i].width, compressedMipmaps[i].height, config.depth}, {0, 0, 0, i}, false);
 	}
 
+	variance.clear();
+	for (MipLevel& level : compressedMipmaps)
+	{
+		if (!level.variance.empty()) variance.push_back({level.width, level.height, level.level, std::move(level.variance)});
+	}
+
 	config.targetLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	TransitionLayout();
 }
@@ -266,6 +575,8 @@ void Image::Destroy()
 		vkDestroySampler(device->GetLogicalDevice(), sampler, nullptr);
 		sampler = nullptr;
 	}
+
+	variance.clear();
 }
 
 VkImage& Image::GetImage()
@@ -301,6 +612,11 @@ const ImageConfig& Image::GetConfig() const
 	return (config);
 }
 
+const std::vector<MipLevel>& Image::GetVariance() const
+{
+	return (variance);
+}
+
 void Image::TransitionLayout()
 {
 	if (config.currentLayout == config.targetLayout) return;
@@ -343,13 +659,19 @@ void Image::Load(const ImageLoader& imageLoader)
 
 	if (config.compressed && config.createMipmaps) return;
 
+	if (imageLoader.GetConfig().streaming && !config.compressed)
+	{
+		Stream(imageLoader);
+		return;
+	}
+
 	std::vector<unsigned char> pixels{};
 	imageLoader.LoadPixelsThreaded(pixels);
 
 	if (config.compressed)
 	{
 		std::vector<unsigned char> compressedPixels{};
-		imageLoader.LoadCompressedPixels(compressedPixels, pixels.data(), {config.width, config.height}, (config.normal ? CompressionType::BC5 : CompressionType::BC1));
+		imageLoader.LoadCompressedPixels(compressedPixels, pixels.data(), {config.width, config.height}, GetCompressionType());
 		Update(&compressedPixels[0], compressedPixels.size(), {config.width, config.height, config.depth});
 	}
 	else
@@ -358,11 +680,192 @@ void Image::Load(const ImageLoader& imageLoader)
 	}
 }
 
+void Image::LoadCached(const ImageLoader& imageLoader)
+{
+	if (!image) throw (std::runtime_error("Image does not exist"));
+	if (!device) throw (std::runtime_error("Image has no device"));
+
+	const uint64_t key = GetCacheKey(imageLoader);
+
+	CachedTexture cachedTexture{};
+	std::vector<MipLevel> levels{};
+
+	if (!TextureCache::Load(key, cachedTexture) || !ValidCachedLevels(cachedTexture.levels))
+	{
+		// Unmaps a rejected file before it is replaced.
+		cachedTexture = CachedTexture{};
+
+		levels = LoadLevels(imageLoader);
+		TextureCache::Store(key, levels);
+
+		for (const MipLevel& level : levels)
+		{
+			cachedTexture.levels.push_back({level.width, level.height, level.level, level.pixels.data(), level.pixels.size(),
+				(level.variance.empty() ? nullptr : level.variance.data()), level.variance.size()});
+		}
+	}
+
+	UploadLevels(cachedTexture.levels);
+	KeepVariance(cachedTexture.levels);
+}
+
+std::vector<MipLevel> Image::LoadLevels(const ImageLoader& imageLoader) const
+{
+	const CompressionType compressionType = GetCompressionType();
+
+	if (config.compressed && config.createMipmaps) return (imageLoader.LoadCompressedMipmaps(config.mipLevels, config.srgb, compressionType));
+
+	std::vector<MipLevel> levels(1);
+	levels[0].width = config.width;
+	levels[0].height = config.height;
+	levels[0].level = 0;
+	imageLoader.LoadPixelsThreaded(levels[0].pixels);
+
+	if (config.compressed)
+	{
+		std::vector<unsigned char> compressedPixels{};
+		imageLoader.LoadCompressedPixels(compressedPixels, levels[0].pixels.data(), {config.width, config.height}, compressionType);
+		levels[0].pixels = std::move(compressedPixels);
+	}
+
+	return (levels);
+}
+
+uint64_t Image::GetCacheKey(const ImageLoader& imageLoader) const
+{
+	const FileView& source = imageLoader.GetFile();
+	const ImageLoaderConfig& loaderConfig = imageLoader.GetConfig();
+
+	// Every option that changes the uploaded bytes is part of the key.
+	const uint64_t options[] =
+	{
+		config.width, config.height, config.mipLevels, config.format,
+		config.createMipmaps, config.srgb, config.compressed, config.normal,
+		loaderConfig.fancyUpsampling, loaderConfig.progressiveScans, loaderConfig.scaleLevel,
+		static_cast<uint64_t>(loaderConfig.compressionMode), static_cast<uint64_t>(config.compressionType),
+		static_cast<uint64_t>(loaderConfig.mipFilter), loaderConfig.normalMap, loaderConfig.normalVariance,
+	};
+
+	uint64_t key = TextureCache::Hash(source.GetData(), source.GetSize());
+	key = TextureCache::Hash(options, sizeof(options), key);
+
+	return (key);
+}
+
+// Cache files only know their own layout, so a stale or corrupt file could describe levels that do not fit the image
+// and make the upload copy past the end of its staging buffer. Any level that differs from what LoadLevels makes is a miss.
+bool Image::ValidCachedLevels(const std::vector<MipLevelView>& levels) const
+{
+	const size_t levelCount = (config.compressed && config.createMipmaps ? config.mipLevels : 1);
+	if (levels.size() != levelCount) return (false);
+
+	const size_t blockBytes = (GetCompressionType() == CompressionType::BC1 || GetCompressionType() == CompressionType::BC4 ? 8 : 16);
+	const size_t texelBytes = TexelBytes(config.format);
+	if (!config.compressed && !texelBytes) return (false);
+
+	for (size_t i = 0; i < levelCount; i++)
+	{
+		const MipLevelView& level = levels[i];
+		const size_t width = LevelSize(config.width, static_cast<uint32_t>(i));
+		const size_t height = LevelSize(config.height, static_cast<uint32_t>(i));
+		const size_t size = (config.compressed ? ((width + 3) / 4) * ((height + 3) / 4) * blockBytes : width * height * texelBytes);
+
+		if (level.level != i || level.width != width || level.height != height || level.size != size) return (false);
+		if (level.varianceSize && level.varianceSize != width * height) return (false);
+	}
+
+	return (true);
+}
+
+// Copies the variance out of the levels, as cached levels point into a mapping that is closed after the upload.
+void Image::KeepVariance(const std::vector<MipLevelView>& levels)
+{
+	variance.clear();
+
+	for (const MipLevelView& level : levels)
+	{
+		if (!level.varianceSize) continue;
+
+		variance.push_back({level.width, level.height, level.level, std::vector<unsigned char>(level.variance, level.variance + level.varianceSize)});
+	}
+}
+
+CompressionType Image::GetCompressionType() const
+{
+	if (config.compressionType != CompressionType::None) return (config.compressionType);
+
+	return (config.normal ? CompressionType::BC5 : CompressionType::BC1);
+}
+
+void Image::UploadLevels(const std::vector<MipLevelView>& levels)
+{
+	for (const MipLevelView& level : levels)
+	{
+		UploadLevel(level, !config.createMipmaps);
+	}
+
+	if (!config.createMipmaps) return;
+
+	// Uncompressed chains may only store the first level, the rest is generated on the device.
+	if (levels.size() < config.mipLevels)
+	{
+		GenerateMipmaps();
+		return;
+	}
+
+	config.targetLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	TransitionLayout();
+}
+
+void Image::UploadLevel(const MipLevelView& level, bool transition)
+{
+	Buffer stagingBuffer;
+	BufferConfig stagingConfig = Buffer::StagingConfig();
+	stagingConfig.size = level.size;
+	stagingBuffer.Create(stagingConfig, nullptr, device);
+
+	memcpy(stagingBuffer.GetAddress(), level.pixels, level.size);
+
+	Point<uint32_t, 3> extent(static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height), config.depth);
+	Upload(stagingBuffer, extent, {0, 0, 0, static_cast<int32_t>(level.level)}, transition);
+}
+
 void Image::Update(unsigned char* data, size_t size, Point<uint32_t, 3> extent, Point<int32_t, 4> offset, bool transition)
 {
 	if (!image) throw (std::runtime_error("Image does not exist"));
 	if (!device) throw (std::runtime_error("Image has no device"));
 
+	Buffer stagingBuffer;
+	BufferConfig stagingConfig = Buffer::StagingConfig();
+	stagingConfig.size = size;
+	stagingBuffer.Create(stagingConfig, data, device);
+
+	Upload(stagingBuffer, extent, offset, transition);
+}
+
+void Image::Stream(const ImageLoader& imageLoader)
+{
+	if (!image) throw (std::runtime_error("Image does not exist"));
+	if (!device) throw (std::runtime_error("Image has no device"));
+
+	const size_t rowSize = config.width * imageLoader.GetChannels();
+
+	Buffer stagingBuffer;
+	BufferConfig stagingConfig = Buffer::StagingConfig();
+	stagingConfig.size = rowSize * config.height;
+	stagingBuffer.Create(stagingConfig, nullptr, device);
+
+	unsigned char* address = static_cast<unsigned char*>(stagingBuffer.GetAddress());
+	imageLoader.StreamPixels([address, rowSize](const unsigned char* pixels, size_t row, size_t rowCount)
+	{
+		memcpy(address + row * rowSize, pixels, rowCount * rowSize);
+	});
+
+	Upload(stagingBuffer, {config.width, config.height, config.depth});
+}
+
+void Image::Upload(Buffer& stagingBuffer, Point<uint32_t, 3> extent, Point<int32_t, 4> offset, bool transition)
+{
 	if (extent.x() == 0 && extent.y() == 0 && extent.z() == 0) extent = {config.width, config.height, 1};
 
 	VkImageLayout originalLayout = config.currentLayout;
@@ -373,10 +876,6 @@ void Image::Update(unsigned char* data, size_t size, Point<uint32_t, 3> extent,
 		TransitionLayout();
 	}
 
-	Buffer stagingBuffer;
-	BufferConfig stagingConfig = Buffer::StagingConfig();
-	stagingConfig.size = size;
-	stagingBuffer.Create(stagingConfig, data, device);
 	stagingBuffer.CopyTo(*this, extent, offset);
 	stagingBuffer.Destroy();
 
@@ -515,10 +1014,22 @@ void Image::CreateView(VkImageView& view, const VkImage& image, const ImageViewC
 	createInfo.components = config.components;
 	createInfo.subresourceRange = config.subresourceRange;
 
+	VkImageViewUsageCreateInfo usageInfo{};
+	usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+	usageInfo.usage = config.usage;
+	if (config.usage) createInfo.pNext = &usageInfo;
+
 	if (vkCreateImageView(device->GetLogicalDevice(), &createInfo, nullptr, &view) != VK_SUCCESS)
 		throw (std::runtime_error("Failed to create image view"));
 }
 
+void Image::DestroyMipmapPipeline()
+{
+	mipmapPipeline.Destroy();
+	mipmapDescriptor.Destroy();
+	mipmapDevice = nullptr;
+}
+
 std::map<VkImageLayout, VkAccessFlags> Image::transitionAccesses =
 	{
 		std::pair<VkImageLayout, VkAccessFlags>{VK_IMAGE_LAYOUT_UNDEFINED, 0},
@@ -0,0 +1,333 @@
+#include "json.hpp"
+
+#include <stdexcept>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+#define JSON_MAX_DEPTH 256
+
+JsonValue::Iterator::Iterator(const JsonDocument* iteratorDocument, uint32_t iteratorIndex) : document(iteratorDocument), index(iteratorIndex) {}
+
+JsonValue JsonValue::Iterator::operator*() const
+{
+	return (JsonValue(document, index));
+}
+
+JsonValue::Iterator& JsonValue::Iterator::operator++()
+{
+	index = document->nodes[index].end;
+
+	return (*this);
+}
+
+bool JsonValue::Iterator::operator!=(const Iterator& other) const
+{
+	return (index != other.index);
+}
+
+JsonValue::JsonValue()
+{
+
+}
+
+JsonValue::JsonValue(const JsonDocument* valueDocument, uint32_t valueIndex) : document(valueDocument), index(valueIndex) {}
+
+bool JsonValue::Valid() const
+{
+	return (document != nullptr);
+}
+
+JsonType JsonValue::Type() const
+{
+	if (!document) return (JsonType::Null);
+
+	return (document->nodes[index].type);
+}
+
+bool JsonValue::Is(JsonType type) const
+{
+	return (document && document->nodes[index].type == type);
+}
+
+std::string_view JsonValue::Key() const
+{
+	if (!document) return ("");
+
+	return (document->Text(document->nodes[index].key, document->nodes[index].keyLength));
+}
+
+size_t JsonValue::Size() const
+{
+	if (!document) return (0);
+
+	return (document->nodes[index].size);
+}
+
+JsonValue JsonValue::operator[](std::string_view key) const
+{
+	if (!Is(JsonType::Object)) return (JsonValue());
+
+	for (JsonValue member : *this)
+	{
+		if (member.Key() == key) return (member);
+	}
+
+	return (JsonValue());
+}
+
+JsonValue JsonValue::operator[](size_t element) const
+{
+	if (!Is(JsonType::Array) || element >= Size()) return (JsonValue());
+
+	uint32_t child = index + 1;
+	for (size_t i = 0; i < element; i++) { child = document->nodes[child].end; }
+
+	return (JsonValue(document, child));
+}
+
+double JsonValue::Number(double fallback) const
+{
+	if (!Is(JsonType::Number)) return (fallback);
+
+	const std::string_view text = document->Text(document->nodes[index].text, document->nodes[index].textLength);
+
+	double number = fallback;
+	std::from_chars(text.data(), text.data() + text.size(), number);
+
+	return (number);
+}
+
+size_t JsonValue::Integer(size_t fallback) const
+{
+	if (!Is(JsonType::Number)) return (fallback);
+
+	const double number = Number(-1.0);
+	if (number < 0.0 || number > static_cast<double>(std::numeric_limits<uint32_t>::max())) return (fallback);
+
+	return (static_cast<size_t>(number));
+}
+
+bool JsonValue::Boolean(bool fallback) const
+{
+	if (!Is(JsonType::Boolean)) return (fallback);
+
+	return (document->nodes[index].size != 0);
+}
+
+std::string_view JsonValue::String(std::string_view fallback) const
+{
+	if (!Is(JsonType::String)) return (fallback);
+
+	return (document->Text(document->nodes[index].text, document->nodes[index].textLength));
+}
+
+JsonValue::Iterator JsonValue::begin() const
+{
+	if (!document) return (Iterator(nullptr, 0));
+
+	return (Iterator(document, index + 1));
+}
+
+JsonValue::Iterator JsonValue::end() const
+{
+	if (!document) return (Iterator(nullptr, 0));
+
+	return (Iterator(document, document->nodes[index].end));
+}
+
+JsonDocument::JsonDocument()
+{
+
+}
+
+JsonDocument::JsonDocument(std::string_view text)
+{
+	Parse(text);
+}
+
+void JsonDocument::Parse(std::string_view text)
+{
+	source = text;
+	position = 0;
+	nodes.clear();
+
+	if (text.size() >= UINT32_MAX) Fail("Document too large");
+
+	// Pretty printed glTF has a value every dozen bytes or so. Reserved pages that are never
+	// written are not paged in, so erring on the large side is cheaper than growing the table.
+	nodes.reserve(text.size() / 8 + 16);
+
+	ParseValue(0, 0, 0);
+	SkipWhitespace();
+
+	if (position != source.size()) Fail("Unexpected data after document");
+}
+
+JsonValue JsonDocument::Root() const
+{
+	if (nodes.empty()) return (JsonValue());
+
+	return (JsonValue(this, 0));
+}
+
+void JsonDocument::Fail(const std::string& message) const
+{
+	throw (std::runtime_error("Invalid JSON: " + message + " at offset " + std::to_string(position)));
+}
+
+void JsonDocument::SkipWhitespace()
+{
+	while (position < source.size())
+	{
+		const char c = source[position];
+		if (c != ' ' && c != '\n' && c != '\r' && c != '\t') break;
+		position++;
+	}
+}
+
+std::string_view JsonDocument::Text(uint32_t start, uint32_t length) const
+{
+	return (source.substr(start, length));
+}
+
+void JsonDocument::ParseString(uint32_t& start, uint32_t& length)
+{
+	start = static_cast<uint32_t>(++position);
+
+	while (position < source.size())
+	{
+		const char c = source[position];
+
+		if (c == '"')
+		{
+			length = static_cast<uint32_t>(position++ - start);
+			return;
+		}
+
+		if (c == '\\') position++;
+		else if (static_cast<unsigned char>(c) < 0x20) Fail("Control character in string");
+
+		position++;
+	}
+
+	Fail("Unterminated string");
+}
+
+void JsonDocument::ParseNumber(Node& node)
+{
+	const size_t start = position;
+	auto digits = [this]()
+	{
+		const size_t first = position;
+		while (position < source.size() && source[position] >= '0' && source[position] <= '9') { position++; }
+		if (position == first) Fail("Invalid number");
+	};
+
+	// Only the grammar is checked here, the value is converted by JsonValue::Number when it is read.
+	if (source[position] == '-') position++;
+	else if (source[position] < '0' || source[position] > '9') Fail("Unexpected character");
+
+	digits();
+
+	if (position < source.size() && source[position] == '.')
+	{
+		position++;
+		digits();
+	}
+
+	if (position < source.size() && (source[position] == 'e' || source[position] == 'E'))
+	{
+		position++;
+		if (position < source.size() && (source[position] == '+' || source[position] == '-')) position++;
+		digits();
+	}
+
+	node.text = static_cast<uint32_t>(start);
+	node.textLength = static_cast<uint32_t>(position - start);
+}
+
+void JsonDocument::ParseValue(uint32_t key, uint32_t keyLength, size_t depth)
+{
+	if (depth > JSON_MAX_DEPTH) Fail("Nesting too deep");
+
+	SkipWhitespace();
+	if (position >= source.size()) Fail("Unexpected end of document");
+
+	// Children are appended after their parent, so the parent is addressed by index as the table may grow.
+	const uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	nodes[index].key = key;
+	nodes[index].keyLength = keyLength;
+
+	const char c = source[position];
+
+	if (c == '{' || c == '[')
+	{
+		const bool object = (c == '{');
+		const char close = (object ? '}' : ']');
+
+		nodes[index].type = (object ? JsonType::Object : JsonType::Array);
+		position++;
+		SkipWhitespace();
+
+		if (position < source.size() && source[position] == close) position++;
+		else
+		{
+			while (true)
+			{
+				uint32_t name = 0;
+				uint32_t nameLength = 0;
+
+				if (object)
+				{
+					SkipWhitespace();
+					if (position >= source.size() || source[position] != '"') Fail("Expected member name");
+					ParseString(name, nameLength);
+
+					SkipWhitespace();
+					if (position >= source.size() || source[position] != ':') Fail("Expected ':'");
+					position++;
+				}
+
+				ParseValue(name, nameLength, depth + 1);
+				nodes[index].size++;
+
+				SkipWhitespace();
+				if (position >= source.size()) Fail("Unexpected end of document");
+
+				if (source[position] == ',') position++;
+				else if (source[position] == close) { position++; break; }
+				else Fail("Expected ',' or closing bracket");
+			}
+		}
+	}
+	else if (c == '"')
+	{
+		nodes[index].type = JsonType::String;
+		ParseString(nodes[index].text, nodes[index].textLength);
+	}
+	else if (source.compare(position, 4, "true") == 0)
+	{
+		nodes[index].type = JsonType::Boolean;
+		nodes[index].size = 1;
+		position += 4;
+	}
+	else if (source.compare(position, 5, "false") == 0)
+	{
+		nodes[index].type = JsonType::Boolean;
+		position += 5;
+	}
+	else if (source.compare(position, 4, "null") == 0)
+	{
+		nodes[index].type = JsonType::Null;
+		position += 4;
+	}
+	else
+	{
+		nodes[index].type = JsonType::Number;
+		ParseNumber(nodes[index]);
+	}
+
+	nodes[index].end = static_cast<uint32_t>(nodes.size());
+}
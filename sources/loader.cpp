@@ -4,15 +4,23 @@
 #include "bitmask.hpp"
 #include "printer.hpp"
 #include "time.hpp"
+#include "scheduler.hpp"
+#include "json.hpp"
 
-#include <fstream>
 #include <sstream>
+#include <fstream>
+#include <numeric>
 #include <filesystem>
-#include <thread>
-#include <future>
 #include <cstdint>
 #include <cstring>
 #include <algorithm>
+#include <bit>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LOADER_SSE2
+#include <emmintrin.h>
+#endif
 
 ByteReader::ByteReader(const uint8_t* data, size_t size) : position(data), end(data + size) {}
 
@@ -58,6 +66,25 @@ uint32_t ByteReader::Read32()
 	return (result);
 }
 
+uint8_t ByteReader::Peek8(size_t offset) const
+{
+	if (BytesLeft() <= offset) throw (std::runtime_error("Byte reader out of bounds (Peek8)"));
+
+	return (position[offset]);
+}
+
+uint64_t ByteReader::Peek64() const
+{
+	if (BytesLeft() < 8) throw (std::runtime_error("Byte reader out of bounds (Peek64)"));
+
+	uint64_t result;
+	std::memcpy(&result, position, 8);
+
+	if constexpr (std::endian::native == std::endian::little) result = std::byteswap(result);
+
+	return (result);
+}
+
 void ByteReader::Skip(size_t bytes)
 {
 	if (BytesLeft() < bytes) throw (std::runtime_error("Byte reader out of bounds (Skip)"));
@@ -89,28 +116,13 @@ ImageMarker ByteReader::NextMarker()
 	return (static_cast<ImageMarker>(byte));
 }
 
-point3D AttributeInfo::Translation() const
-{
-	point3D result;
-
-	size_t start = 0;
-	size_t end = translation.find(',');
-	result.x() = std::stof(translation.substr(start, end - start));
-	start = end + 1;
-	end = translation.find(',');
-	result.y() = std::stof(translation.substr(start, end - start));
-	start = translation.rfind(',') + 1;
-	result.z() = std::stof(translation.substr(start));
-
-	return (result);
-}
-
 ModelLoader::ModelLoader(const std::string& name, const ModelType& type, size_t meshID)
 {
 	switch (type)
 	{
 		case ModelType::Obj: GetObjInfo(name, meshID); break;
 		case ModelType::Gltf: GetGltfInfo(name, meshID); break;
+		case ModelType::Glb: GetGlbInfo(name, meshID); break;
 		default: throw (std::runtime_error("Not a valid model type"));
 	}
 }
@@ -120,61 +132,247 @@ ModelLoader::~ModelLoader()
 
 }
 
-std::string ModelLoader::GetValue(const std::string& content, const std::string& target) const
+#define GLTF_BYTE 5120
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_SHORT 5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+#define GLB_MAGIC 0x46546C67u
+#define GLB_CHUNK_JSON 0x4E4F534Au
+#define GLB_CHUNK_BIN 0x004E4942u
+
+static mat4 GltfNodeMatrix(const JsonValue& node)
 {
-	if (!content.contains(target)) return ("");
+	mat4 result = mat4::Identity();
+
+	// Both glTF and mat4 store matrices column by column.
+	JsonValue matrix = node["matrix"];
+	if (matrix.Size() == 16)
+	{
+		for (size_t i = 0; i < 16; i++) { result[i] = static_cast<float>(matrix[i].Number(0.0)); }
+		return (result);
+	}
+
+	JsonValue translation = node["translation"];
+	JsonValue rotation = node["rotation"];
+	JsonValue scale = node["scale"];
 
-	size_t start = content.find(target) + target.size() + 3;
-	size_t end = content.find('\n', start);
+	const float x = static_cast<float>(rotation[0].Number(0.0));
+	const float y = static_cast<float>(rotation[1].Number(0.0));
+	const float z = static_cast<float>(rotation[2].Number(0.0));
+	const float w = static_cast<float>(rotation[3].Number(1.0));
 
-	return (content.substr(start, end - start));
+	const float rotationMatrix[3][3] =
+	{
+		{1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y - z * w), 2.0f * (x * z + y * w)},
+		{2.0f * (x * y + z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z - x * w)},
+		{2.0f * (x * z - y * w), 2.0f * (y * z + x * w), 1.0f - 2.0f * (x * x + y * y)},
+	};
+
+	// Translation * rotation * scale, written out as scaled rotation columns and a translation column.
+	for (size_t c = 0; c < 3; c++)
+	{
+		const float factor = static_cast<float>(scale[c].Number(1.0));
+		for (size_t r = 0; r < 3; r++) { result(r, c) = rotationMatrix[r][c] * factor; }
+
+		result(c, 3) = static_cast<float>(translation[c].Number(0.0));
+	}
+
+	return (result);
 }
 
-AttributeInfo ModelLoader::GetAttribute(const std::string& accessContent, const std::string& viewContent) const
+static void ResolveGltfScene(GltfInfo& gltf)
 {
-	AttributeInfo attributeInfo{};
-	attributeInfo.accessContent = accessContent;
-	attributeInfo.viewIndex = GetValue(attributeInfo.accessContent, "bufferView");
-	attributeInfo.component = GetValue(attributeInfo.accessContent, "componentType");
-	attributeInfo.count = GetValue(attributeInfo.accessContent, "count");
-	attributeInfo.type = GetValue(attributeInfo.accessContent, "type");
-	attributeInfo.viewContent = viewContent;
-	attributeInfo.bufferIndex = GetValue(attributeInfo.viewContent, "buffer");
-	attributeInfo.length = GetValue(attributeInfo.viewContent, "byteLength");
-	attributeInfo.offset = GetValue(attributeInfo.viewContent, "byteOffset");
+	std::vector<bool> visited(gltf.nodes.size(), false);
+	std::vector<std::pair<size_t, size_t>> stack;
 
-	return (attributeInfo);
+	for (size_t root : gltf.roots)
+	{
+		stack.emplace_back(root, SIZE_MAX);
+	}
+
+	// Nodes are resolved parents first, a node reached twice would make the hierarchy a graph and is skipped.
+	while (!stack.empty())
+	{
+		auto [index, parent] = stack.back();
+		stack.pop_back();
+
+		if (index >= gltf.nodes.size() || visited[index]) continue;
+		visited[index] = true;
+
+		GltfNode& node = gltf.nodes[index];
+		node.world = (parent == SIZE_MAX ? node.local : gltf.nodes[parent].world * node.local);
+
+		if (node.mesh < gltf.meshes.size()) gltf.meshes[node.mesh].nodes.push_back(index);
+
+		for (auto child = node.children.rbegin(); child != node.children.rend(); child++)
+		{
+			stack.emplace_back(*child, index);
+		}
+	}
+
+	for (GltfMesh& mesh : gltf.meshes) { std::sort(mesh.nodes.begin(), mesh.nodes.end()); }
 }
 
-std::string ModelLoader::GetPart(const std::string& content, const std::string& target, const std::pair<char, char>& pair)
+static size_t GltfComponents(std::string_view type)
 {
-	std::string result = "";
+	if (type == "SCALAR") return (1);
+	if (type == "VEC2") return (2);
+	if (type == "VEC3") return (3);
+	if (type == "VEC4" || type == "MAT2") return (4);
+	if (type == "MAT3") return (9);
+	if (type == "MAT4") return (16);
+
+	throw (std::runtime_error("Invalid glTF accessor type: " + std::string(type)));
+}
 
-	std::pair<size_t, size_t> range = Utilities::FindPair(content, content.find(target), pair);
-	if (range.first != range.second) result = content.substr(range.first + 1, range.second - range.first - 1);
+GltfInfo ModelLoader::ParseGltf(std::string_view json)
+{
+	JsonDocument document(json);
+	JsonValue root = document.Root();
 
-	return (result);
+	GltfInfo gltf{};
+
+	gltf.accessors.reserve(root["accessors"].Size());
+	for (JsonValue value : root["accessors"])
+	{
+		GltfAccessor& accessor = gltf.accessors.emplace_back();
+		accessor.bufferView = value["bufferView"].Integer(SIZE_MAX);
+		accessor.byteOffset = value["byteOffset"].Integer(0);
+		accessor.componentType = value["componentType"].Integer(0);
+		accessor.count = value["count"].Integer(0);
+		accessor.components = GltfComponents(value["type"].String());
+		accessor.normalized = value["normalized"].Boolean(false);
+	}
+
+	gltf.bufferViews.reserve(root["bufferViews"].Size());
+	for (JsonValue value : root["bufferViews"])
+	{
+		GltfBufferView& view = gltf.bufferViews.emplace_back();
+		view.buffer = value["buffer"].Integer(0);
+		view.byteOffset = value["byteOffset"].Integer(0);
+		view.byteLength = value["byteLength"].Integer(0);
+		view.byteStride = value["byteStride"].Integer(0);
+	}
+
+	gltf.buffers.reserve(root["buffers"].Size());
+	for (JsonValue value : root["buffers"])
+	{
+		GltfBuffer& buffer = gltf.buffers.emplace_back();
+		buffer.uri = value["uri"].String();
+		buffer.byteLength = value["byteLength"].Integer(0);
+	}
+
+	gltf.meshes.reserve(root["meshes"].Size());
+	for (JsonValue value : root["meshes"])
+	{
+		GltfMesh& mesh = gltf.meshes.emplace_back();
+		mesh.name = value["name"].String();
+		mesh.primitive = gltf.primitives.size();
+		mesh.primitiveCount = value["primitives"].Size();
+
+		for (JsonValue primitiveValue : value["primitives"])
+		{
+			GltfPrimitive& primitive = gltf.primitives.emplace_back();
+			primitive.mesh = gltf.meshes.size() - 1;
+			JsonValue attributes = primitiveValue["attributes"];
+			primitive.position = attributes["POSITION"].Integer(SIZE_MAX);
+			primitive.normal = attributes["NORMAL"].Integer(SIZE_MAX);
+			primitive.coordinate = attributes["TEXCOORD_0"].Integer(SIZE_MAX);
+			primitive.color = attributes["COLOR_0"].Integer(SIZE_MAX);
+			primitive.indices = primitiveValue["indices"].Integer(SIZE_MAX);
+		}
+	}
+
+	gltf.nodes.reserve(root["nodes"].Size());
+	for (JsonValue value : root["nodes"])
+	{
+		GltfNode& node = gltf.nodes.emplace_back();
+		node.name = value["name"].String();
+		node.mesh = value["mesh"].Integer(SIZE_MAX);
+
+		node.local = GltfNodeMatrix(value);
+
+		node.children.reserve(value["children"].Size());
+		for (JsonValue child : value["children"]) { node.children.push_back(child.Integer(SIZE_MAX)); }
+	}
+
+	JsonValue scenes = root["scenes"];
+	JsonValue scene = scenes[root["scene"].Integer(0)];
+
+	if (scene.Valid())
+	{
+		for (JsonValue node : scene["nodes"]) { gltf.roots.push_back(node.Integer(SIZE_MAX)); }
+	}
+	else
+	{
+		// Without scenes every node that is nobody's child is drawn.
+		std::vector<bool> child(gltf.nodes.size(), false);
+		for (const GltfNode& node : gltf.nodes)
+		{
+			for (size_t index : node.children) { if (index < child.size()) child[index] = true; }
+		}
+
+		for (size_t i = 0; i < gltf.nodes.size(); i++) { if (!child[i]) gltf.roots.push_back(i); }
+	}
+
+	ResolveGltfScene(gltf);
+
+	return (gltf);
 }
 
-std::vector<std::string> ModelLoader::GetList(const std::string& content, const std::string& target, const std::pair<char, char>& pair)
+static size_t GltfComponentSize(size_t componentType)
 {
-	std::vector<std::string> result;
+	switch (componentType)
+	{
+		case GLTF_BYTE: case GLTF_UNSIGNED_BYTE: return (1);
+		case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return (2);
+		case GLTF_UNSIGNED_INT: case GLTF_FLOAT: return (4);
+		default: throw (std::runtime_error("Invalid glTF component type: " + std::to_string(componentType)));
+	}
+}
+
+AttributeInfo ModelLoader::GetAttribute(size_t accessor) const
+{
+	if (accessor >= gltf->accessors.size()) throw (std::runtime_error("Invalid glTF accessor index: " + info.name));
+
+	const GltfAccessor& access = gltf->accessors[accessor];
+
+	AttributeInfo attributeInfo{};
+	attributeInfo.accessor = accessor;
+	attributeInfo.count = access.count;
+	attributeInfo.component = access.componentType;
+	attributeInfo.components = access.components;
+	attributeInfo.normalized = access.normalized;
 
-	size_t end = 0;
+	const size_t elementSize = GltfComponentSize(access.componentType) * access.components;
+	attributeInfo.stride = elementSize;
 
-	while (end != std::string::npos && end < content.size())
+	// Accessors without a view are all zeros.
+	if (access.bufferView == SIZE_MAX)
 	{
-		size_t start = end;
-		if (target != "") start = content.find(target, end);
-		std::pair<size_t, size_t> range = Utilities::FindPair(content, start, pair);
-		if (range.first == range.second) break;
-		if (range.first == std::string::npos || range.second == std::string::npos) break;
-		if (range.first >= content.size() || range.second >= content.size()) break;
-		result.push_back(content.substr(range.first + 1, range.second - range.first - 1));
-		end = range.second + 1;
+		attributeInfo.viewIndex = SIZE_MAX;
+		attributeInfo.bufferIndex = SIZE_MAX;
+		return (attributeInfo);
 	}
 
-	return (result);
+	if (access.bufferView >= gltf->bufferViews.size()) throw (std::runtime_error("Invalid glTF buffer view index: " + info.name));
+
+	const GltfBufferView& view = gltf->bufferViews[access.bufferView];
+
+	attributeInfo.viewIndex = access.bufferView;
+	attributeInfo.bufferIndex = view.buffer;
+	if (view.byteStride != 0) attributeInfo.stride = view.byteStride;
+	attributeInfo.offset = view.byteOffset + access.byteOffset;
+	attributeInfo.length = (access.count == 0 ? 0 : (access.count - 1) * attributeInfo.stride + elementSize);
+
+	if (access.byteOffset > view.byteLength || attributeInfo.length > view.byteLength - access.byteOffset)
+	{
+		throw (std::runtime_error("glTF accessor is outside of its buffer view: " + info.name));
+	}
+
+	return (attributeInfo);
 }
 
 void ModelLoader::GetObjInfo(const std::string& name, size_t meshID)
@@ -182,89 +380,187 @@ void ModelLoader::GetObjInfo(const std::string& name, size_t meshID)
 	info.name = name;
 }
 
+static std::string DecodeUri(std::string_view uri)
+{
+	std::string result;
+	result.reserve(uri.size());
+
+	for (size_t i = 0; i < uri.size(); i++)
+	{
+		if (uri[i] == '%' && i + 2 < uri.size())
+		{
+			result.push_back(static_cast<char>(std::stoi(std::string(uri.substr(i + 1, 2)), nullptr, 16)));
+			i += 2;
+		}
+		else result.push_back(uri[i]);
+	}
+
+	return (result);
+}
+
 void ModelLoader::GetGltfInfo(const std::string& name, size_t meshID)
 {
 	info.name = name;
 	info.type = ModelType::Gltf;
 
-	std::string path = Utilities::GetPath() + "/resources/models/" + name + ".gltf";
-	std::string file = Utilities::FileToString(path);
+	std::string path = Utilities::GetPath() + "/resources/models/" + name;
 
-	std::string meshesInfo = GetPart(file, "meshes", {'[', ']'});
+	FileView view(path + ".gltf", FileAccess::Sequential);
+	gltf = std::make_shared<const GltfInfo>(ParseGltf(view.GetString()));
 
-	std::vector<std::string> primitives = GetList(meshesInfo, "primitives", {'[', ']'});
-	std::vector<std::string> meshes;
+	MapBuffers(name, ModelBuffer{});
+	GetPrimitiveInfo(meshID);
+}
 
-	for (std::string primitive : primitives)
-	{
-		std::vector<std::string> temp = GetList(primitive, "", {'{', '}'});
-		meshes.insert(meshes.end(), temp.begin(), temp.end());
-	}
+static uint32_t ReadLittle32(const uint8_t* data)
+{
+	return (C32(data[0]) | (C32(data[1]) << 8) | (C32(data[2]) << 16) | (C32(data[3]) << 24));
+}
+
+void ModelLoader::GetGlbInfo(const std::string& name, size_t meshID)
+{
+	info.name = name;
+	info.type = ModelType::Glb;
 
-	if (meshID >= meshes.size()) throw (std::runtime_error("Invalid mesh ID"));
+	std::string path = Utilities::GetPath() + "/resources/models/" + name + ".glb";
+	std::shared_ptr<const FileView> file = std::make_shared<const FileView>(path, FileAccess::Sequential);
 
-	info.ID = meshID;
-	info.count = meshes.size() - 1 - meshID;
+	const uint8_t* data = file->GetData();
+	size_t size = file->GetSize();
+
+	if (size < 20 || ReadLittle32(data) != GLB_MAGIC) throw (std::runtime_error("Invalid GLB file: " + name));
+	if (ReadLittle32(data + 4) != 2) throw (std::runtime_error("Unsupported GLB version: " + name));
 
-	std::string positionsIndex = GetValue(meshes[meshID], "POSITION");
-	std::string normalsIndex = GetValue(meshes[meshID], "NORMAL");
-	std::string coordinatesIndex = GetValue(meshes[meshID], "TEXCOORD_0");
-	std::string indicesIndex = GetValue(meshes[meshID], "indices");
+	// The header length wins over the file size, anything after it is not part of the container.
+	size = std::min(size, CST(ReadLittle32(data + 8)));
 
-	std::string accessInfo = GetPart(file, "accessors", {'[', ']'});
-	std::vector<std::string> accessors = GetList(accessInfo, "", {'{', '}'});
+	const size_t jsonLength = ReadLittle32(data + 12);
+	if (ReadLittle32(data + 16) != GLB_CHUNK_JSON || jsonLength > size - 20) throw (std::runtime_error("Invalid GLB JSON chunk: " + name));
 
-	std::string viewInfo = GetPart(file, "bufferViews", {'[', ']'});
-	std::vector<std::string> views = GetList(viewInfo, "", {'{', '}'});
+	gltf = std::make_shared<const GltfInfo>(ParseGltf(std::string_view(reinterpret_cast<const char*>(data + 20), jsonLength)));
 
-	if (positionsIndex != "")
+	ModelBuffer binary{};
+	const size_t chunk = 20 + jsonLength;
+
+	if (chunk + 8 <= size && ReadLittle32(data + chunk + 4) == GLB_CHUNK_BIN)
 	{
-		info.vertexConfig = Bitmask::SetFlag(info.vertexConfig, Position);
-		std::string accessContent = accessors[std::stoi(positionsIndex)];
-		std::string viewContent = views[std::stoi(GetValue(accessContent, "bufferView"))];
-		info.attributes[AttributeType::Position] = GetAttribute(accessContent, viewContent);
-		info.size = std::max(info.size, (size_t)std::stoul(info.attributes[AttributeType::Position].count));
+		const size_t binaryLength = ReadLittle32(data + chunk);
+		if (binaryLength > size - chunk - 8) throw (std::runtime_error("Invalid GLB BIN chunk: " + name));
+
+		binary = ModelBuffer{file, chunk + 8, binaryLength};
+		file->Advise(FileAccess::Random, binary.offset, binary.size);
+	}
 
-		std::string nodeInfo = GetPart(file.substr(file.rfind("nodes")), "nodes", {'[', ']'});
-		if (nodeInfo != "")
+	MapBuffers(name, binary);
+	GetPrimitiveInfo(meshID);
+}
+
+void ModelLoader::MapBuffers(const std::string& name, const ModelBuffer& binary)
+{
+	const std::string directory = Utilities::GetPath() + "/resources/models/";
+
+	// Buffers are mapped once for all meshes, attributes are read out of the mappings so only
+	// the ranges that are used get paged in.
+	buffers = std::make_shared<std::vector<ModelBuffer>>();
+	buffers->reserve(gltf->buffers.size());
+
+	for (const GltfBuffer& buffer : gltf->buffers)
+	{
+		if (buffer.uri.starts_with("data:")) throw (std::runtime_error("Embedded glTF buffers are not supported: " + name));
+
+		// A buffer without uri is the BIN chunk of a GLB file, or the .bin next to a .gltf file.
+		if (buffer.uri.empty() && binary.file)
 		{
-			std::vector<std::string> nodes = GetList(nodeInfo, "", {'{', '}'});
-			if (nodes.size() > meshID)
-			{
-				std::string translation = GetPart(nodes[meshID], "translation", {'[', ']'});
-				if (translation != "") info.attributes[AttributeType::Position].translation = translation;
-			}
+			buffers->push_back(binary);
+			continue;
 		}
+
+		std::string bufferPath = (buffer.uri.empty() ? directory + name + ".bin" : directory + DecodeUri(buffer.uri));
+		std::shared_ptr<const FileView> file = std::make_shared<const FileView>(bufferPath, FileAccess::Random);
+		buffers->push_back(ModelBuffer{file, 0, file->GetSize()});
+	}
+}
+
+void ModelLoader::GetPrimitiveInfo(size_t meshID)
+{
+	if (meshID >= gltf->primitives.size()) throw (std::runtime_error("Invalid mesh ID"));
+
+	info.ID = meshID;
+	info.count = gltf->primitives.size() - 1 - meshID;
+	info.size = 0;
+	info.vertexConfig = None;
+	info.indexConfig = VK_INDEX_TYPE_NONE_KHR;
+	info.attributes.clear();
+	info.instances.clear();
+
+	const GltfPrimitive& primitive = gltf->primitives[meshID];
+
+	// Files without nodes draw every mesh once where it is.
+	const GltfMesh& mesh = gltf->meshes[primitive.mesh];
+	if (gltf->nodes.empty()) info.instances.push_back(mat4::Identity());
+	for (size_t node : mesh.nodes) { info.instances.push_back(gltf->nodes[node].world); }
+
+	if (primitive.position != SIZE_MAX)
+	{
+		info.vertexConfig = Bitmask::SetFlag(info.vertexConfig, Position);
+		info.attributes[AttributeType::Position] = GetAttribute(primitive.position);
+		info.size = std::max(info.size, info.attributes[AttributeType::Position].count);
 	}
 
-	if (normalsIndex != "")
+	if (primitive.normal != SIZE_MAX)
 	{
 		info.vertexConfig = Bitmask::SetFlag(info.vertexConfig, Normal);
-		std::string accessContent = accessors[std::stoi(normalsIndex)];
-		std::string viewContent = views[std::stoi(GetValue(accessContent, "bufferView"))];
-		info.attributes[AttributeType::Normal] = GetAttribute(accessContent, viewContent);
-		info.size = std::max(info.size, (size_t)std::stoul(info.attributes[AttributeType::Normal].count));
+		info.attributes[AttributeType::Normal] = GetAttribute(primitive.normal);
+		info.size = std::max(info.size, info.attributes[AttributeType::Normal].count);
 	}
 
-	if (coordinatesIndex != "")
+	if (primitive.coordinate != SIZE_MAX)
 	{
 		info.vertexConfig = Bitmask::SetFlag(info.vertexConfig, Coordinate);
-		std::string accessContent = accessors[std::stoi(coordinatesIndex)];
-		std::string viewContent = views[std::stoi(GetValue(accessContent, "bufferView"))];
-		info.attributes[AttributeType::Coordinate] = GetAttribute(accessContent, viewContent);
-		info.size = std::max(info.size, (size_t)std::stoul(info.attributes[AttributeType::Coordinate].count));
+		info.attributes[AttributeType::Coordinate] = GetAttribute(primitive.coordinate);
+		info.size = std::max(info.size, info.attributes[AttributeType::Coordinate].count);
+	}
+
+	if (primitive.color != SIZE_MAX)
+	{
+		info.vertexConfig = Bitmask::SetFlag(info.vertexConfig, Color);
+		info.attributes[AttributeType::Color] = GetAttribute(primitive.color);
+		info.size = std::max(info.size, info.attributes[AttributeType::Color].count);
 	}
 
-	if (indicesIndex != "")
+	// Indices do not count towards the vertex count.
+	if (primitive.indices != SIZE_MAX)
 	{
-		info.indexConfig = VK_INDEX_TYPE_UINT32;
-		std::string accessContent = accessors[std::stoi(indicesIndex)];
-		std::string viewContent = views[std::stoi(GetValue(accessContent, "bufferView"))];
-		info.attributes[AttributeType::Index] = GetAttribute(accessContent, viewContent);
-		info.size = std::max(info.size, (size_t)std::stoul(info.attributes[AttributeType::Index].count));
+		info.attributes[AttributeType::Index] = GetAttribute(primitive.indices);
+		info.indexConfig = (info.attributes[AttributeType::Index].component == GLTF_UNSIGNED_INT ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16);
 	}
 }
 
+size_t ModelLoader::MeshCount() const
+{
+	return (info.ID + info.count + 1);
+}
+
+ModelLoader ModelLoader::GetMesh(size_t meshID) const
+{
+	if (!gltf) return (ModelLoader(info.name, info.type, meshID));
+
+	ModelLoader loader = *this;
+	loader.GetPrimitiveInfo(meshID);
+
+	return (loader);
+}
+
+std::vector<ModelLoader> ModelLoader::GetMeshes() const
+{
+	std::vector<ModelLoader> meshes;
+	meshes.reserve(MeshCount());
+
+	for (size_t i = 0; i < MeshCount(); i++) { meshes.push_back(GetMesh(i)); }
+
+	return (meshes);
+}
+
 const ModelInfo& ModelLoader::GetInfo() const
 {
 	return (info);
@@ -279,23 +575,139 @@ void ModelLoader::GetBytes(char* address, const AttributeType& type)
 {
 	if (!info.attributes.contains(type)) throw (std::runtime_error("Model does not contain attribute type"));
 
-	std::string path = Utilities::GetPath() + "/resources/models/" + info.name + ".bin";
-	std::ifstream file(path, std::ios::binary);
+	std::memcpy(address, GetData(type), info.attributes[type].Length());
+}
+
+const uint8_t* ModelLoader::GetData(const AttributeType& type) const
+{
+	if (!info.attributes.contains(type)) throw (std::runtime_error("Model does not contain attribute type"));
+
+	const AttributeInfo& attribute = info.attributes.at(type);
+	if (!buffers || attribute.bufferIndex >= buffers->size()) throw (std::runtime_error("Model has no buffer file: " + info.name));
+
+	const ModelBuffer& buffer = (*buffers)[attribute.bufferIndex];
+	const size_t offset = attribute.Offset();
+	const size_t length = attribute.Length();
+
+	if (offset > buffer.size || length > buffer.size - offset) throw (std::runtime_error("Attribute is outside of buffer file: " + info.name));
+
+	buffer.file->Prefetch(buffer.offset + offset, length);
+
+	return (buffer.GetData() + offset);
+}
+
+template <typename T>
+static void ConvertAttribute(const uint8_t* source, const AttributeInfo& attribute, size_t components, float* destination, size_t stride)
+{
+	uint8_t* target = reinterpret_cast<uint8_t*>(destination);
+
+	// Normalized integers map to [0, 1] or [-1, 1], the most negative signed value is clamped to -1.
+	const float scale = (attribute.normalized && !std::is_floating_point_v<T> ? 1.0f / static_cast<float>(std::numeric_limits<T>::max()) : 1.0f);
+	const float minimum = (attribute.normalized ? -1.0f : -std::numeric_limits<float>::max());
+
+	for (size_t i = 0; i < attribute.count; i++)
+	{
+		const uint8_t* element = source + i * attribute.stride;
+		float* values = reinterpret_cast<float*>(target + i * stride);
+
+		for (size_t j = 0; j < components; j++)
+		{
+			T value;
+			std::memcpy(&value, element + j * sizeof(T), sizeof(T));
+			values[j] = std::max(static_cast<float>(value) * scale, minimum);
+		}
+	}
+}
+
+void ModelLoader::ReadFloats(const AttributeType& type, float* destination, size_t components, size_t stride) const
+{
+	if (!info.attributes.contains(type)) throw (std::runtime_error("Model does not contain attribute type"));
+
+	const AttributeInfo& attribute = info.attributes.at(type);
+	components = std::min(components, attribute.components);
+
+	if (attribute.viewIndex == SIZE_MAX)
+	{
+		uint8_t* target = reinterpret_cast<uint8_t*>(destination);
+		for (size_t i = 0; i < attribute.count; i++) { std::fill_n(reinterpret_cast<float*>(target + i * stride), components, 0.0f); }
+		return;
+	}
+
+	const uint8_t* source = GetData(type);
+
+	// The component type is resolved once per attribute, each conversion is a single pass over the elements.
+	switch (attribute.component)
+	{
+		case GLTF_FLOAT: ConvertAttribute<float>(source, attribute, components, destination, stride); break;
+		case GLTF_UNSIGNED_BYTE: ConvertAttribute<uint8_t>(source, attribute, components, destination, stride); break;
+		case GLTF_BYTE: ConvertAttribute<int8_t>(source, attribute, components, destination, stride); break;
+		case GLTF_UNSIGNED_SHORT: ConvertAttribute<uint16_t>(source, attribute, components, destination, stride); break;
+		case GLTF_SHORT: ConvertAttribute<int16_t>(source, attribute, components, destination, stride); break;
+		case GLTF_UNSIGNED_INT: ConvertAttribute<uint32_t>(source, attribute, components, destination, stride); break;
+		default: throw (std::runtime_error("Invalid glTF component type: " + info.name));
+	}
+}
+
+template <typename T, typename D>
+static void ConvertIndices(const uint8_t* source, const AttributeInfo& attribute, D* destination)
+{
+	for (size_t i = 0; i < attribute.count; i++)
+	{
+		T value;
+		std::memcpy(&value, source + i * attribute.stride, sizeof(T));
+
+		// Files often store small meshes with 32-bit indices, so only indices that do not fit are an error.
+		if constexpr (sizeof(T) > sizeof(D))
+		{
+			if (value > std::numeric_limits<D>::max()) throw (std::runtime_error("glTF index does not fit in 16-bit indices: " + std::to_string(value)));
+		}
+
+		destination[i] = static_cast<D>(value);
+	}
+}
 
-	if (!file.is_open()) throw (std::runtime_error("Failed to open file: " + info.name));
+template <typename D>
+static void ReadIndexData(const uint8_t* source, const AttributeInfo& attribute, D* destination)
+{
+	switch (attribute.component)
+	{
+		case GLTF_UNSIGNED_BYTE: ConvertIndices<uint8_t>(source, attribute, destination); break;
+		case GLTF_UNSIGNED_SHORT: ConvertIndices<uint16_t>(source, attribute, destination); break;
+		case GLTF_UNSIGNED_INT: ConvertIndices<uint32_t>(source, attribute, destination); break;
+		default: throw (std::runtime_error("Invalid glTF index component type"));
+	}
+}
 
-	file.seekg(info.attributes[type].Offset());
-	file.read(address, info.attributes[type].Length());
+void ModelLoader::ReadIndices(uint16_t* destination) const
+{
+	ReadIndexData(GetData(AttributeType::Index), info.attributes.at(AttributeType::Index), destination);
+}
 
-	file.close();
+void ModelLoader::ReadIndices(uint32_t* destination) const
+{
+	ReadIndexData(GetData(AttributeType::Index), info.attributes.at(AttributeType::Index), destination);
 }
 
-ImageLoader::ImageLoader(const std::string& name, const ImageType& type)
+ImageLoader::ImageLoader(const std::string& name, const ImageType& type, const ImageLoaderConfig& loaderConfig) : config(loaderConfig)
 {
+	data.normalMap = config.normalMap;
+
 	switch (type)
 	{
-		case ImageType::Jpg: GetJpgInfo(name); LoadEntropyData(); break;
-		case ImageType::Png: return; break;
+		case ImageType::Jpg:
+			GetJpgInfo(name);
+			// Progressive images refine every block over several scans, so they cannot be streamed.
+			if (info.progressive) config.streaming = false;
+			if (config.streaming || config.deferred) PrepareData();
+			else LoadEntropyData();
+			break;
+		case ImageType::Ktx2: GetKtx2Info(name); break;
+		case ImageType::Png:
+			GetPngInfo(name);
+			// Rows are only known once the whole zlib stream is inflated.
+			config.streaming = false;
+			if (!config.deferred) LoadEntropyData();
+			break;
 		default: throw (std::runtime_error("Not a valid image type"));
 	}
 
@@ -312,11 +724,12 @@ void ImageLoader::GetJpgInfo(const std::string& name)
 	info.name = name;
 	info.type = ImageType::Jpg;
 
+	// The mapping is kept for the entropy decode and streaming, which read the scans straight from it.
 	std::string path = Utilities::GetPath() + "/resources/textures/" + name + ".jpg";
-	std::vector<char> file = Utilities::FileToBinary(path);
-	const uint8_t* rawData = reinterpret_cast<const uint8_t*>(file.data());
+	file = FileView(path, FileAccess::Sequential);
+	const uint8_t* rawData = file.GetData();
 
-	ByteReader br(rawData, file.size());
+	ByteReader br(rawData, file.GetSize());
 
 	if (!br.AtMarker(ImageMarker::SOI)) throw (std::runtime_error("Invalid JPG file."));
 
@@ -324,8 +737,10 @@ void ImageLoader::GetJpgInfo(const std::string& name)
 	{
 		ImageMarker next = br.NextMarker();
 
-		if (next == ImageMarker::SOF0)
+		if (next == ImageMarker::SOF0 || next == ImageMarker::SOF2)
 		{
+			info.progressive = (next == ImageMarker::SOF2);
+
 			//info.startOfFrameInfo.start = br.BytesLeft();
 			info.startOfFrameInfo.start = br.Offset(rawData);
 			info.startOfFrameInfo.length = CST(br.Read16());
@@ -447,997 +862,3592 @@ void ImageLoader::GetJpgInfo(const std::string& name)
 		else if (next == ImageMarker::DRI)
 		{
 			size_t length = CST(br.Read16()) - 2;
-			br.Skip(length);
+			info.restartInterval = CST(br.Read16());
+			br.Skip(length - 2);
 		}
 		else if (next == ImageMarker::SOS)
 		{
-			info.startOfScanInfo.start = br.Offset(rawData);
-			info.startOfScanInfo.length = CST(br.Read16());
-			info.startOfScanInfo.componentCount = CST(br.Read8());
-			for (size_t i = 0; i < info.startOfScanInfo.componentCount; i++)
+			SOSInfo scan{};
+
+			scan.start = br.Offset(rawData);
+			scan.length = CST(br.Read16());
+			scan.componentCount = CST(br.Read8());
+			for (size_t i = 0; i < scan.componentCount; i++)
 			{
 				size_t componentID = CST(br.Read8());
 				uint8_t AD = CST(br.Read8());
 				std::pair<size_t, size_t> tables{ CST(AD >> 4), CST(AD & 0x0F)};
-				info.startOfScanInfo.componentTables[componentID] = tables;
+				scan.componentTables[componentID] = tables;
 			}
-
-			if (info.startOfScanInfo.start + info.startOfScanInfo.length > br.Offset(rawData))
+			scan.spectralStart = CST(br.Read8());
+			scan.spectralEnd = CST(br.Read8());
+			uint8_t A = br.Read8();
+			scan.approximationHigh = CST(A >> 4);
+			scan.approximationLow = CST(A & 0x0F);
+			scan.huffmanCount = info.huffmanInfos.size();
+			scan.restartInterval = info.restartInterval;
+
+			if (info.scans.empty()) info.startOfScanInfo = scan;
+			info.scans.push_back(scan);
+
+			if (scan.start + scan.length > br.Offset(rawData))
 			{
-				br.Skip((info.startOfScanInfo.start + info.startOfScanInfo.length) - br.Offset(rawData));
+				br.Skip((scan.start + scan.length) - br.Offset(rawData));
 			}
 		}
 	}
 }
 
-void ImageLoader::BuildHuffmanTree(std::string current, HuffmanTree& start, std::vector<HuffmanCode>& codes)
-{
-	if (current.size() >= 16) return;
+static const std::array<uint8_t, 12> ktx2Identifier = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
 
-	std::string leftCode = current + "0";
-	std::string rightCode = current + "1";
+// The SGD fields follow 13 32-bit fields, so the header is packed to keep them at the file's offsets.
+#pragma pack(push, 4)
+struct Ktx2Header
+{
+	uint32_t format = 0;
+	uint32_t typeSize = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t depth = 0;
+	uint32_t layerCount = 0;
+	uint32_t faceCount = 0;
+	uint32_t levelCount = 0;
+	uint32_t supercompression = 0;
+	uint32_t DFDOffset = 0;
+	uint32_t DFDLength = 0;
+	uint32_t KVDOffset = 0;
+	uint32_t KVDLength = 0;
+	uint64_t SGDOffset = 0;
+	uint64_t SGDLength = 0;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(Ktx2Header) == 68, "KTX2 header must match the file layout");
+
+struct Ktx2Level
+{
+	uint64_t offset = 0;
+	uint64_t length = 0;
+	uint64_t uncompressedLength = 0;
+};
 
-	for (const HuffmanCode& code : codes)
+// Bytes of a 4x4 block of the block compressed formats, 0 for formats stored per pixel.
+static size_t FormatBlockBytes(VkFormat format)
+{
+	switch (format)
 	{
-		std::string codeString = Utilities::ToBits(code.code).substr(16 - CST(code.length));
-
-		if (codeString == leftCode)
-		{
-			start.Expand({true, code}, Left);
-		}
-		else if (codeString == rightCode)
-		{
-			start.Expand({true, code}, Right);
-		}
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC4_SNORM_BLOCK: return (8);
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC5_SNORM_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK: return (16);
+		default: return (0);
 	}
+}
 
-	if (!start.HasSide(Left))
-	{
-		start.Expand({false, {}}, Left);
-		BuildHuffmanTree(leftCode, *start.GetSide(Left), codes);
-	}
-	if (!start.HasSide(Right))
-	{
-		start.Expand({false, {}}, Right);
-		BuildHuffmanTree(rightCode, *start.GetSide(Right), codes);
-	}
+static bool IsKtx2Format(VkFormat format)
+{
+	return (FormatBlockBytes(format) != 0 || format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB);
 }
 
-std::array<int16_t, 1 << FAST_BITS> ImageLoader::BuildFastHuffmanTable(std::vector<HuffmanCode>& codes)
+static size_t LevelBytes(VkFormat format, size_t width, size_t height)
 {
-	std::array<int16_t, 1 << FAST_BITS> table{};
+	const size_t blockBytes = FormatBlockBytes(format);
 
-	for (size_t i = 0; i < (1 << FAST_BITS); i++) table[i] = -1;
+	if (blockBytes) return (((width + 3) / 4) * ((height + 3) / 4) * blockBytes);
 
-	for (size_t i = 0; i < codes.size(); i++)
+	return (width * height * 4);
+}
+
+void ImageLoader::GetKtx2Info(const std::string& name)
+{
+	info.name = name;
+	info.type = ImageType::Ktx2;
+
+	std::string path = Utilities::GetPath() + "/resources/textures/" + name + ".ktx2";
+	file = FileView(path, FileAccess::Sequential);
+	const uint8_t* rawData = file.GetData();
+
+	Ktx2Header header{};
+	if (file.GetSize() < ktx2Identifier.size() + sizeof(header)) throw (std::runtime_error("Invalid KTX2 file"));
+	if (std::memcmp(rawData, ktx2Identifier.data(), ktx2Identifier.size()) != 0) throw (std::runtime_error("Invalid KTX2 file"));
+
+	std::memcpy(&header, rawData + ktx2Identifier.size(), sizeof(header));
+
+	info.format = static_cast<VkFormat>(header.format);
+
+	if (!IsKtx2Format(info.format)) throw (std::runtime_error("Unsupported KTX2 format"));
+	if (header.supercompression != 0) throw (std::runtime_error("Supercompressed KTX2 files are not supported"));
+	if (header.depth > 1 || header.layerCount > 1 || header.faceCount != 1) throw (std::runtime_error("Only 2D KTX2 textures are supported"));
+	if (header.width == 0 || header.height == 0) throw (std::runtime_error("Invalid KTX2 dimensions"));
+
+	// A level count of 0 asks for the chain to be generated at load, which leaves a single stored level.
+	const size_t levelCount = std::max(header.levelCount, 1u);
+	const size_t indexStart = ktx2Identifier.size() + sizeof(header);
+
+	if (indexStart + levelCount * sizeof(Ktx2Level) > file.GetSize()) throw (std::runtime_error("Invalid KTX2 level index"));
+
+	info.levels.resize(levelCount);
+
+	for (size_t i = 0; i < levelCount; i++)
 	{
-		int length = codes[i].length;
-		if (length <= FAST_BITS)
-		{
-			int shift = FAST_BITS - length;
-			int base = codes[i].code << shift;
-			int repetitions = 1 << shift;
+		Ktx2Level level{};
+		std::memcpy(&level, rawData + indexStart + i * sizeof(level), sizeof(level));
 
-			for (size_t r = 0; r < repetitions; r++)
-			{
-				table[base + r] = i;
-			}
-		}
+		MipLevelView& view = info.levels[i];
+		view.width = std::max(CST(header.width) >> i, CST(1));
+		view.height = std::max(CST(header.height) >> i, CST(1));
+		view.level = i;
+		view.size = level.length;
+
+		if (level.offset > file.GetSize() || level.length > file.GetSize() - level.offset) throw (std::runtime_error("KTX2 level outside of file"));
+		if (level.length != LevelBytes(info.format, view.width, view.height)) throw (std::runtime_error("Invalid KTX2 level size"));
+
+		view.pixels = rawData + level.offset;
 	}
 
-	return (table);
+	data.dimensions = {header.width, header.height, 1};
+	data.HVC = {1, 1, 4};
 }
 
-/*DataBlock ImageLoader::IDCTBlock(const DataBlock& input)
+static const std::array<uint16_t, 29> inflateLengthBases = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const std::array<uint8_t, 29> inflateLengthExtras = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const std::array<uint16_t, 30> inflateDistanceBases = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const std::array<uint8_t, 30> inflateDistanceExtras = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const std::array<uint8_t, 19> inflateCodeLengthOrder = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+Inflater::Inflater(const uint8_t* data, size_t size) : position(data), end(data + size)
 {
-	DataBlock result{};
 
-	for (int y = 0; y < 8; y++)
-	{
-		for (int x = 0; x < 8; x++)
-		{
-			float sum = 0;
+}
 
-			for (int v = 0; v < 8; v++)
-			{
-				for (int u = 0; u < 8; u++)
-				{
-					float AU = (u == 0) ? sqrt12 : 1;
-					float AV = (v == 0) ? sqrt12 : 1;
-					sum += AU * AV * input[v * 8 + u] * 
-						cos(((2 * x + 1) * u * M_PI) / 16.0) * 
-						cos(((2 * y + 1) * v * M_PI) / 16.0);
-				}
-			}
-
-			int16_t intSum = static_cast<int16_t>(sum * 0.25);
-			intSum += 128;
-			if (intSum < 0) intSum = 0;
-			if (intSum > 255) intSum = 255;
-
-			result[y * 8 + x] = intSum;
-		}
-	}
-
-	return (result);
-}*/
-
-DataBlock ImageLoader::FIDCTBlock(const DataBlock& input)
+void Inflater::Refill()
 {
-	static std::array<float, 64> transform{};
-	static bool computed = false;
-
-	if (!computed)
+	if (end - position >= 8)
 	{
-		computed = true;
-		for (int v = 0; v < 8; v++)
-		{
-			for (int u = 0; u < 8; u++)
-			{
-				float AU = (u == 0) ? sqrt12 : 1;
-				transform[v * 8 + u] = 0.5f * AU * cos(((2 * v + 1) * u * 3.14159265359) / 16.0);
-			}
-		}
-	}
-
-	DataBlock result{};
-	std::array<float, 64> temp{};
+		uint64_t word;
+		std::memcpy(&word, position, 8);
 
-	for (int x = 0; x < 8; x++)
-	{
-		for (int y = 0; y < 8; y++)
-		{
-			float sum = 0;
+		if constexpr (std::endian::native == std::endian::big) word = std::byteswap(word);
 
-			for (int k = 0; k < 8; k++)
-			{
-				sum += transform[y * 8 + k] * input[k * 8 + x];
-			}
+		bitBuffer |= word << bitCount;
+		position += (63 - bitCount) >> 3;
+		bitCount |= 56;
 
-			temp[y * 8 + x] = sum;
-		}
+		return;
 	}
 
-	for (int y = 0; y < 8; y++)
+	// Past the end the stream is padded with zeros, Inflate checks none of them were used.
+	while (bitCount <= 56)
 	{
-		for (int x = 0; x < 8; x++)
-		{
-			float sum = 0;
-
-			for (int k = 0; k < 8; k++)
-			{
-				sum += transform[x * 8 + k] * temp[y * 8 + k];
-			}
+		uint64_t byte = 0;
 
-			int intSum = std::lround(sum + 128);
-			if (intSum < 0) intSum = 0;
-			if (intSum > 255) intSum = 255;
+		if (position < end) byte = *position++;
+		else padding++;
 
-			result[y * 8 + x] = static_cast<int16_t>(intSum);
-		}
+		bitBuffer |= byte << bitCount;
+		bitCount += 8;
 	}
-
-	return (result);
 }
 
-const ImageInfo& ImageLoader::GetInfo() const
+uint32_t Inflater::ReadBits(size_t amount)
 {
-	return (info);
-}
+	if (bitCount < amount) Refill();
 
-uint8_t ImageLoader::NextEntropySymbol(EntropyReader& er, size_t tableIndex)
-{
-	//const std::pair<bool, uint8_t> fastResult = er.NextSymbolFast(data.fastHuffmanTables[tableIndex], info.huffmanInfos[tableIndex].huffmanCodes);
-	//
-	//if (fastResult.first)
-	//{
-	//	//fastFound++;
-	//	return (fastResult.second);
-	//}
-	//else
-	//{
-	//	//slowFound++;
-	//	return (er.NextSymbolFast(data.huffmanTables[tableIndex]));
-	//}
+	const uint32_t result = static_cast<uint32_t>(bitBuffer & ((uint64_t(1) << amount) - 1));
+	bitBuffer >>= amount;
+	bitCount -= amount;
 
-	return (er.NextSymbolFast(data.huffmanTables[tableIndex]));
+	return (result);
 }
 
-static double subTime = 0;
-static double addTime = 0;
-static double restTime = 0;
-
-void ImageLoader::LoadEntropyData()
+uint32_t Inflater::DecodeSymbol(const InflateTable& table)
 {
-	double start = Time::GetCurrentTime();
+	if (bitCount < 15) Refill();
 
-	//if (info.name.contains("norm")) data.normalMap = true;
+	const uint16_t entry = table.lookup[bitBuffer & ((1 << INFLATE_FAST_BITS) - 1)];
 
-	size_t totalBlockCount = 0;
-	size_t maxH = 0;
-	size_t maxV = 0;
-	for (const Point<size_t, 4>& component : info.startOfFrameInfo.components)
+	if (entry)
 	{
-		totalBlockCount += component.y() * component.z();
-		maxH = std::max(maxH, component.y());
-		maxV = std::max(maxV, component.z());
-	}
-	data.MCUCount.x() = std::ceil(info.startOfFrameInfo.width / (maxH * 8));
-	data.MCUCount.y() = std::ceil(info.startOfFrameInfo.height / (maxV * 8));
-	data.MCUCount.z() = data.MCUCount.x() * data.MCUCount.y();
-	data.maxHV.x() = maxH;
-	data.maxHV.y() = maxV;
-	data.dimensions = {info.startOfFrameInfo.width, info.startOfFrameInfo.height, 1};
-	size_t H = info.startOfFrameInfo.width / data.MCUCount.x();
-	size_t V = info.startOfFrameInfo.height / data.MCUCount.y();
-	size_t C = (info.greyScale ? 1 : 4);
-	//if (data.normalMap) {C = 2;}
-	data.HVC = {H, V, C};
-	data.subSamplePower = std::max(maxH, maxV);
+		const size_t length = entry & 15;
+		bitBuffer >>= length;
+		bitCount -= length;
 
-	//std::cout << info.name << " = " << data.HVC << std::endl;
-	
-
-	//std::cout << "mcucount: " << data.MCUCount << std::endl; 
-
-	data.blocks.resize(totalBlockCount * data.MCUCount.z());
-	for (size_t i = 0; i < data.blocks.size(); i++)
-	{
-		data.blocks[i] = DataBlock{};
+		return (entry >> 4);
 	}
 
-	//double treeStart = Time::GetCurrentTime();
+	// Codes are stored MSB first, so longer codes are walked one bit at a time.
+	int code = 0;
+	int first = 0;
+	int index = 0;
 
-	data.huffmanTables.resize(info.huffmanInfos.size(), HuffmanTree({false, {}}));
-	data.fastHuffmanTables.resize(info.huffmanInfos.size());
-	size_t HI = 0;
-	for (HuffmanTree& table : data.huffmanTables)
+	for (size_t length = 1; length < 16; length++)
 	{
-		BuildHuffmanTree("", table, info.huffmanInfos[HI].huffmanCodes);
-		data.fastHuffmanTables[HI] = BuildFastHuffmanTable(info.huffmanInfos[HI].huffmanCodes);
-		//data.huffmanTableInfos.push_back({table});
-		HI++;
-	}
+		code |= static_cast<int>(bitBuffer & 1);
+		bitBuffer >>= 1;
+		bitCount--;
 
-	//std::cout << "Trees build in: " << (Time::GetCurrentTime() - treeStart) * 1000 << std::endl;
-
-	//double fileStart = Time::GetCurrentTime();
-
-	std::string path = Utilities::GetPath() + "/resources/textures/" + info.name + ".jpg";
-	std::vector<char> file = Utilities::FileToBinary(path);
-	const uint8_t* rawData = reinterpret_cast<const uint8_t*>(file.data());
+		const int count = table.counts[length];
+		if (code - count < first) return (table.symbols[index + (code - first)]);
 
-	//std::cout << "File loaded in: " << (Time::GetCurrentTime() - fileStart) * 1000 << std::endl;
-
-	ByteReader br(rawData, file.size());
-	br.Skip(info.startOfScanInfo.start + info.startOfScanInfo.length);
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
 
-	size_t blockIndex = 0;
-	uint8_t symbol;
-	int value;
-	//int DCs[info.startOfFrameInfo.components.size()]{};
-	std::vector<int> DCs(info.startOfFrameInfo.components.size());
+	throw (std::runtime_error("Invalid deflate code"));
+}
 
-	EntropyReader er(br);
+void Inflater::BuildTable(const uint8_t* lengths, size_t count, InflateTable& table)
+{
+	table.counts.fill(0);
+	table.lookup.fill(0);
 
-	//double entropyStart = Time::GetCurrentTime();
-	//double treeTime = 0;
-	//double transformTime = 0;
-	//double readTime = 0;
+	for (size_t i = 0; i < count; i++) table.counts[lengths[i]]++;
+	table.counts[0] = 0;
 
-	for (size_t MCU = 0; MCU < data.MCUCount.z(); MCU++)
+	int left = 1;
+	for (size_t length = 1; length < 16; length++)
 	{
-		size_t componentIndex = 0;
-		for (auto table : info.startOfScanInfo.componentTables)
-		{
-			Point<size_t, 4> currentComponent;
-			for (Point<size_t, 4> componentInfo : info.startOfFrameInfo.components)
-			{
-				if (componentInfo.x() == table.first)
-				{
-					currentComponent = componentInfo;
-					break;
-				}
-			}
+		left = (left << 1) - table.counts[length];
+		if (left < 0) throw (std::runtime_error("Oversubscribed deflate code lengths"));
+	}
 
-			int DCIndex = -1;
-			int ACIndex = -1;
+	std::array<uint16_t, 16> offsets{};
+	std::array<uint32_t, 16> nextCode{};
+	uint32_t code = 0;
 
-			for (size_t i = 0; i < info.huffmanInfos.size(); i++)
-			{
-				if (info.huffmanInfos[i].type == 0 && info.huffmanInfos[i].ID == table.second.first) DCIndex = i;
-				if (info.huffmanInfos[i].type == 1 && info.huffmanInfos[i].ID == table.second.second) ACIndex = i;
-			}
+	for (size_t length = 1; length < 16; length++)
+	{
+		offsets[length] = (length == 1 ? 0 : offsets[length - 1] + table.counts[length - 1]);
+		code = (code + (length == 1 ? 0 : table.counts[length - 1])) << 1;
+		nextCode[length] = code;
+	}
 
-			if (DCIndex == -1 || ACIndex == -1) throw (std::runtime_error("No valid tables found"));
+	for (size_t symbol = 0; symbol < count; symbol++)
+	{
+		const size_t length = lengths[symbol];
+		if (!length) continue;
 
-			size_t blockCount = currentComponent.y() * currentComponent.z();
-			for (size_t BI = 0; BI < blockCount; BI++)
-			{
-				//double treeTimeStart = Time::GetCurrentTime();
+		table.symbols[offsets[length]++] = C16(symbol);
 
-				//symbol = er.NextSymbolFast(data.huffmanTables[DCIndex]);
-				symbol = NextEntropySymbol(er, DCIndex);
+		const uint32_t symbolCode = nextCode[length]++;
+		if (length > INFLATE_FAST_BITS) continue;
 
-				//treeTime += (Time::GetCurrentTime() - treeTimeStart);
+		// The stream holds codes MSB first, the lookup is indexed LSB first.
+		uint32_t reversed = 0;
+		for (size_t i = 0; i < length; i++) reversed |= ((symbolCode >> i) & 1) << (length - 1 - i);
 
-				//double readTimeStart = Time::GetCurrentTime();
+		for (uint32_t i = reversed; i < (1u << INFLATE_FAST_BITS); i += (1u << length))
+		{
+			table.lookup[i] = C16((symbol << 4) | length);
+		}
+	}
+}
 
-				//if (symbol > 0)	{ value = er.ReadBits(symbol); }
-				if (symbol > 0)	{ value = er.ReadBitsBuffer(symbol); }
-				else { value = 0; }
+void Inflater::ReadDynamicTables(InflateTable& lengths, InflateTable& distances)
+{
+	const size_t lengthCount = ReadBits(5) + 257;
+	const size_t distanceCount = ReadBits(5) + 1;
+	const size_t codeLengthCount = ReadBits(4) + 4;
 
-				//readTime += (Time::GetCurrentTime() - readTimeStart);
+	if (lengthCount > 286 || distanceCount > 30) throw (std::runtime_error("Invalid deflate table sizes"));
 
-				DCs[componentIndex] += value;
+	std::array<uint8_t, 19> codeLengths{};
+	for (size_t i = 0; i < codeLengthCount; i++) codeLengths[inflateCodeLengthOrder[i]] = C8(ReadBits(3));
 
-				data.blocks[blockIndex][0] = static_cast<int16_t>(DCs[componentIndex]  * info.quantizationTables[currentComponent.w()].values[0]);
+	InflateTable codeTable{};
+	BuildTable(codeLengths.data(), codeLengths.size(), codeTable);
 
-				for (size_t i = 1; i < 64; i++)
-				{
-					//treeTimeStart = Time::GetCurrentTime();
+	std::array<uint8_t, 286 + 30> codes{};
+	const size_t total = lengthCount + distanceCount;
+	size_t i = 0;
 
-					//symbol = er.NextSymbolFast(data.huffmanTables[ACIndex]);
-					symbol = NextEntropySymbol(er, ACIndex);
+	while (i < total)
+	{
+		const uint32_t symbol = DecodeSymbol(codeTable);
 
-					//treeTime += (Time::GetCurrentTime() - treeTimeStart);
+		if (symbol < 16)
+		{
+			codes[i++] = C8(symbol);
+			continue;
+		}
 
-					if (symbol == 0x00) break;
-					if (symbol == 0xF0)
-					{
-						for (size_t j = 0; j < 16; j++)
-						{
-							if (i >= 64) throw (std::runtime_error("16 zero run length: out of block bounds"));
+		uint8_t value = 0;
+		size_t repeat = 0;
 
-							data.blocks[blockIndex][zigzagTable[i]] = 0;
-							if (j + 1 < 16) i++;
-						}
-						continue;
-					}
+		if (symbol == 16)
+		{
+			if (i == 0) throw (std::runtime_error("Deflate length repeat without previous length"));
+			value = codes[i - 1];
+			repeat = 3 + ReadBits(2);
+		}
+		else if (symbol == 17) repeat = 3 + ReadBits(3);
+		else repeat = 11 + ReadBits(7);
 
-					int run = symbol >> 4;
-					int size = symbol & 0x0F;
+		if (i + repeat > total) throw (std::runtime_error("Deflate code lengths overflow"));
 
-					if (size == 0) throw (std::runtime_error("size equals zero"));
+		std::fill_n(codes.begin() + i, repeat, value);
+		i += repeat;
+	}
 
-					for (int j = 0; j < run; j++)
-					{
-						if (i >= 64) throw (std::runtime_error("size run length: out of block bounds"));
+	if (codes[256] == 0) throw (std::runtime_error("Deflate block has no end code"));
 
-						data.blocks[blockIndex][zigzagTable[i]] = 0;
-						i++;
-					}
+	BuildTable(codes.data(), lengthCount, lengths);
+	BuildTable(codes.data() + lengthCount, distanceCount, distances);
+}
 
-					//readTimeStart = Time::GetCurrentTime();
+uint8_t* Inflater::InflateBlock(uint8_t* output, uint8_t* outputStart, uint8_t* outputEnd, const InflateTable& lengths, const InflateTable& distances)
+{
+	while (true)
+	{
+		uint32_t symbol = DecodeSymbol(lengths);
 
-					//value = er.ReadBits(size) * info.quantizationTables[currentComponent.w()].values[zigzagTable[i]];
-					value = er.ReadBitsBuffer(size) * info.quantizationTables[currentComponent.w()].values[zigzagTable[i]];
+		if (symbol < 256)
+		{
+			if (output == outputEnd) throw (std::runtime_error("Inflated data is longer than expected"));
+			*output++ = C8(symbol);
+			continue;
+		}
 
-					//readTime += (Time::GetCurrentTime() - readTimeStart);
+		if (symbol == 256) return (output);
 
-					data.blocks[blockIndex][zigzagTable[i]] = static_cast<int16_t>(value);
-				}
+		symbol -= 257;
+		if (symbol >= inflateLengthBases.size()) throw (std::runtime_error("Invalid deflate length"));
+		const size_t length = inflateLengthBases[symbol] + ReadBits(inflateLengthExtras[symbol]);
 
-				//for (size_t i = 0; i < 64; i++)
-				//{
-				//	data.blocks[blockIndex][i] *= info.quantizationTables[currentComponent.w()].values[i];
-				//}
+		const uint32_t distanceSymbol = DecodeSymbol(distances);
+		if (distanceSymbol >= inflateDistanceBases.size()) throw (std::runtime_error("Invalid deflate distance"));
+		const size_t distance = inflateDistanceBases[distanceSymbol] + ReadBits(inflateDistanceExtras[distanceSymbol]);
 
-				//double transformTimeStart = Time::GetCurrentTime();
+		if (distance > CST(output - outputStart)) throw (std::runtime_error("Deflate distance before start of data"));
+		if (length > CST(outputEnd - output)) throw (std::runtime_error("Inflated data is longer than expected"));
 
-				//data.blocks[blockIndex] = IDCTBlock(data.blocks[blockIndex]);
+		const uint8_t* source = output - distance;
 
-				//data.blocks[blockIndex] = FIDCTBlock(data.blocks[blockIndex]);
+		// Matches at least eight bytes back never read bytes the same copy writes, so they go eight at a time.
+		if (distance >= 8 && CST(outputEnd - output) >= length + 8)
+		{
+			for (size_t i = 0; i < length; i += 8) std::memcpy(output + i, source + i, 8);
+		}
+		else if (distance == 1)
+		{
+			std::memset(output, *source, length);
+		}
+		else
+		{
+			for (size_t i = 0; i < length; i++) output[i] = source[i];
+		}
 
-				//transformTime += (Time::GetCurrentTime() - transformTimeStart);
+		output += length;
+	}
+}
 
-				blockIndex++;
-			}
+void Inflater::Inflate(uint8_t* output, size_t size)
+{
+	static const std::pair<InflateTable, InflateTable> fixedTables = []()
+	{
+		std::pair<InflateTable, InflateTable> tables{};
+		std::array<uint8_t, 288> lengths{};
 
-			componentIndex++;
-		}
-	}
+		std::fill(lengths.begin(), lengths.begin() + 144, 8);
+		std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+		std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+		std::fill(lengths.begin() + 280, lengths.end(), 8);
+		BuildTable(lengths.data(), lengths.size(), tables.first);
 
-	//std::cout << "blocks: " << data.blocks.size() / 6000 << std::endl;
-	//std::cout << "blocks left: " << data.blocks.size() % 6000 << std::endl;
+		lengths.fill(5);
+		BuildTable(lengths.data(), 30, tables.second);
 
-	size_t blockThreadCount = 6000;
-	size_t blockCount = data.blocks.size();
-	size_t threadCount = (blockCount / blockThreadCount);
+		return (tables);
+	}();
 
-	std::vector<std::thread> threads(threadCount);
+	const uint32_t method = ReadBits(8);
+	const uint32_t flags = ReadBits(8);
 
-	for (size_t i = 0; i < threads.size(); i++)
-	{
-		size_t start = i * blockThreadCount;
-		size_t end = std::min((i + 1) * blockThreadCount, blockCount);
+	if ((method & 15) != 8 || ((method << 8) | flags) % 31 != 0 || (flags & 32)) throw (std::runtime_error("Invalid zlib stream"));
 
-		threads[i] = std::thread(TransformBlocks, &data, start, end);
-	}
+	uint8_t* outputEnd = output + size;
+	uint8_t* current = output;
+	bool last = false;
 
-	TransformBlocks(&data, threadCount * blockThreadCount, blockCount);
+	InflateTable lengths{};
+	InflateTable distances{};
 
-	for (size_t i = 0; i < threads.size(); i++)
+	while (!last)
 	{
-		threads[i].join();
-	}
+		last = ReadBits(1);
+		const uint32_t type = ReadBits(2);
 
-	/*std::vector<std::future<void>> threads(threadCount);
+		if (type == 0)
+		{
+			ReadBits(bitCount % 8);
+			const size_t length = ReadBits(16);
+			const size_t inverse = ReadBits(16);
 
-	for (size_t i = 0; i < threads.size(); i++)
-	{
-		size_t start = i * blockThreadCount;
-		size_t end = std::min((i + 1) * blockThreadCount, blockCount);
+			if (length != (~inverse & 0xFFFF)) throw (std::runtime_error("Invalid stored deflate block"));
+			if (length > CST(outputEnd - current)) throw (std::runtime_error("Inflated data is longer than expected"));
 
-		threads[i] = std::async(TransformBlocks, &data, start, end);
-	}
+			size_t remaining = length;
+			while (remaining && bitCount >= 8)
+			{
+				*current++ = C8(ReadBits(8));
+				remaining--;
+			}
 
-	TransformBlocks(&data, threadCount * blockThreadCount, blockCount);
+			if (CST(end - position) < remaining) throw (std::runtime_error("Stored deflate block outside of data"));
 
-	for (size_t i = 0; i < threads.size(); i++)
-	{
-		threads[i].wait();
-	}*/
-	
-	//for (size_t i = 0; i < data.blocks.size(); i++)
-	//{
-	//	data.blocks[i] = FIDCTBlock(data.blocks[i]);
-	//}
+			// The buffer may hold lookahead bits of the bytes copied below.
+			if (remaining) bitBuffer = 0;
 
-	//std::cout << "Tree search time: " << treeTime * 1000 << std::endl;
+			std::memcpy(current, position, remaining);
+			position += remaining;
+			current += remaining;
+		}
+		else if (type == 1)
+		{
+			current = InflateBlock(current, output, outputEnd, fixedTables.first, fixedTables.second);
+		}
+		else if (type == 2)
+		{
+			ReadDynamicTables(lengths, distances);
+			current = InflateBlock(current, output, outputEnd, lengths, distances);
+		}
+		else
+		{
+			throw (std::runtime_error("Invalid deflate block type"));
+		}
 
-	//std::cout << "Read time: " << readTime * 1000 << std::endl;
+		if (padding * 8 > bitCount) throw (std::runtime_error("Deflate stream is truncated"));
+	}
 
-	//std::cout << "Transform time: " << transformTime * 1000 << std::endl;
+	// The Adler-32 checksum that follows is not checked.
+	if (current != outputEnd) throw (std::runtime_error("Inflated data is shorter than expected"));
+}
 
-	//std::cout << "Entropy loaded in: " << (Time::GetCurrentTime() - entropyStart) * 1000 << std::endl;
+static const std::array<uint8_t, 8> pngSignature = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
 
-	std::cout << info.name << " loaded in: " << (Time::GetCurrentTime() - start) * 1000 << " ms." << 
-		" With a total size of: " << (128 * data.blocks.size()) * 0.000001 << " mb." << std::endl;
-	//std::cout << data.blocks.size() << std::endl;
-	//std::cout << info << std::endl << std::endl;
+#define PNG_CHUNK(a, b, c, d) ((C32(a) << 24) | (C32(b) << 16) | (C32(c) << 8) | C32(d))
 
-	//std::cout << "Fast found: " << fastFound << " Slow found: " << slowFound << std::endl;
-	//std::cout << "Add time: " << addTime * 1000 << " Sub time: " << subTime * 1000 << " Rest time: " << restTime * 1000 << std::endl;
-}
+// Start and spacing of the seven Adam7 passes, as x, y, dx and dy.
+static const std::array<std::array<size_t, 4>, 7> adam7Passes =
+	{{
+		{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4}, {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2}
+	}};
 
-void ImageLoader::TransformBlocks(ImageData* data, size_t start, size_t end)
+static size_t PngSamples(size_t colorType)
 {
-	for (size_t i = start; i < end; i++)
+	switch (colorType)
 	{
-		data->blocks[i] = FIDCTBlock(data->blocks[i]);
+		case 0: return (1);
+		case 2: return (3);
+		case 3: return (1);
+		case 4: return (2);
+		case 6: return (4);
+		default: throw (std::runtime_error("Invalid PNG color type"));
 	}
 }
 
-void ImageLoader::LoadBlock(std::vector<unsigned char>& buffer, size_t offset) const
+void ImageLoader::GetPngInfo(const std::string& name)
 {
-	size_t pixelIndex = 0;
-	size_t blockIndex = 0;
+	info.name = name;
+	info.type = ImageType::Png;
+
+	std::string path = Utilities::GetPath() + "/resources/textures/" + name + ".png";
+	file = FileView(path, FileAccess::Sequential);
+	const uint8_t* rawData = file.GetData();
 
-	for (size_t y = 0; y < 16; y++)
+	if (file.GetSize() < pngSignature.size() || std::memcmp(rawData, pngSignature.data(), pngSignature.size()) != 0) throw (std::runtime_error("Invalid PNG file"));
+
+	PNGInfo& png = info.pngInfo;
+	ByteReader br(rawData, file.GetSize());
+	br.Skip(pngSignature.size());
+
+	while (br.BytesLeft() >= 12)
 	{
-		for (size_t x = 0; x < 16; x++)
+		const size_t length = br.Read32();
+		const uint32_t type = br.Read32();
+		const size_t start = br.Offset(rawData);
+
+		if (length + 4 > br.BytesLeft()) throw (std::runtime_error("PNG chunk outside of file"));
+
+		ByteReader chunk(rawData + start, length);
+
+		if (type == PNG_CHUNK('I', 'H', 'D', 'R'))
+		{
+			png.width = chunk.Read32();
+			png.height = chunk.Read32();
+			png.bitDepth = chunk.Read8();
+			png.colorType = chunk.Read8();
+			const size_t compression = chunk.Read8();
+			const size_t filter = chunk.Read8();
+			png.interlace = chunk.Read8();
+
+			if (compression != 0 || filter != 0 || png.interlace > 1) throw (std::runtime_error("Unsupported PNG compression, filter or interlace method"));
+			if (png.width == 0 || png.height == 0) throw (std::runtime_error("Invalid PNG dimensions"));
+
+			const size_t samples = PngSamples(png.colorType);
+			const bool validDepth = (png.bitDepth == 8 || png.bitDepth == 16 || (samples == 1 && png.bitDepth < 8 && std::has_single_bit(png.bitDepth)));
+			if (!validDepth || (png.colorType == 3 && png.bitDepth == 16)) throw (std::runtime_error("Invalid PNG bit depth"));
+		}
+		else if (type == PNG_CHUNK('P', 'L', 'T', 'E'))
+		{
+			png.palette.resize(std::min(length / 3, CST(256)));
+			for (std::array<uint8_t, 4>& entry : png.palette)
+			{
+				entry = {chunk.Read8(), chunk.Read8(), chunk.Read8(), 255};
+			}
+		}
+		else if (type == PNG_CHUNK('t', 'R', 'N', 'S'))
 		{
-			int yi = y;
-			int xi = x;
-			int yci = y / 2;
-			int xci = x / 2;
-			if (y < 8 && x < 8)
+			png.transparent = true;
+
+			if (png.colorType == 3)
 			{
-				blockIndex = 0;
+				for (size_t i = 0; i < std::min(length, png.palette.size()); i++) png.palette[i][3] = chunk.Read8();
 			}
-			else if (y < 8 && x >= 8)
+			else if (png.colorType == 0)
 			{
-				blockIndex = 1;
-				xi -= 8;
+				png.transparentColor[0] = chunk.Read16();
 			}
-			else if (y >= 8 && x < 8)
+			else if (png.colorType == 2)
 			{
-				blockIndex = 2;
-				yi -= 8;
+				for (uint16_t& value : png.transparentColor) value = chunk.Read16();
 			}
 			else
 			{
-				blockIndex = 3;
-				xi -= 8;
-				yi -= 8;
+				png.transparent = false;
 			}
+		}
+		else if (type == PNG_CHUNK('I', 'D', 'A', 'T'))
+		{
+			png.dataChunks.push_back({start, length});
+		}
+		else if (type == PNG_CHUNK('I', 'E', 'N', 'D'))
+		{
+			break;
+		}
 
-			double Y = static_cast<double>(data.blocks[blockIndex + (6 * offset)][yi * 8 + xi]);
-			double Cb = static_cast<double>(data.blocks[4 + (6 * offset)][yci * 8 + xci]);
-			double Cr = static_cast<double>(data.blocks[5 + (6 * offset)][yci * 8 + xci]);
+		// The chunk CRC is not checked.
+		br.Skip(length + 4);
+	}
 
-			double R = (Y + 1.402 * (Cr - 128));
-			double G = (Y - 0.34414 * (Cb - 128) - 0.71414 * (Cr - 128));
-			double B = (Y + 1.772 * (Cb - 128));
+	if (png.width == 0) throw (std::runtime_error("PNG has no header"));
+	if (png.dataChunks.empty()) throw (std::runtime_error("PNG has no image data"));
+	if (png.colorType == 3 && png.palette.empty()) throw (std::runtime_error("PNG has no palette"));
 
-			if (R < 0) R = 0;
-			if (R > 255) R = 255;
-			if (G < 0) G = 0;
-			if (G > 255) G = 255;
-			if (B < 0) B = 0;
-			if (B > 255) B = 255;
+	// Only greyscale without transparency stays a single channel, everything else is expanded to RGBA.
+	const size_t channels = ((png.colorType == 0 && !png.transparent) ? 1 : 4);
 
-			unsigned char r = static_cast<unsigned char>(R);
-			unsigned char g = static_cast<unsigned char>(G);
-			unsigned char b = static_cast<unsigned char>(B);
+	data.dimensions = {png.width, png.height, 1};
+	data.HVC = {1, 1, channels};
+}
 
-			buffer[pixelIndex++] = r;
-			buffer[pixelIndex++] = g;
-			buffer[pixelIndex++] = b;
-			buffer[pixelIndex++] = 255;
-		}
-	}
+static uint8_t PaethPredictor(int a, int b, int c)
+{
+	const int pa = std::abs(b - c);
+	const int pb = std::abs(a - c);
+	const int pc = std::abs(a + b - 2 * c);
+
+	if (pa <= pb && pa <= pc) return (C8(a));
+	if (pb <= pc) return (C8(b));
+	return (C8(c));
 }
 
-void ImageLoader::LoadBlockGreyscale(std::vector<unsigned char>& buffer, size_t offset) const
+#ifdef LOADER_SSE2
+static __m128i LoadPixel(const uint8_t* pixel, size_t pixelBytes)
 {
-	size_t pixelIndex = 0;
-	size_t blockIndex = 0;
+	uint64_t value = 0;
+	std::memcpy(&value, pixel, pixelBytes);
+	return (_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&value)));
+}
 
-	for (size_t y = 0; y < 8; y++)
-	{
-		for (size_t x = 0; x < 8; x++)
-		{
-			double Y = static_cast<double>(data.blocks[(offset)][y * 8 + x]);
+static void StorePixel(uint8_t* pixel, __m128i value, size_t pixelBytes)
+{
+	uint64_t result;
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(&result), value);
+	std::memcpy(pixel, &result, pixelBytes);
+}
 
-			double R = Y;
+// Every pixel depends on the one before it, so the SIMD width is one pixel of three to eight bytes.
+static void UnfilterAverageSSE2(uint8_t* row, const uint8_t* previous, size_t size, size_t pixelBytes)
+{
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i left = _mm_setzero_si128();
 
-			if (R < 0) R = 0;
-			if (R > 255) R = 255;
+	for (size_t i = 0; i < size; i += pixelBytes)
+	{
+		const __m128i above = LoadPixel(previous + i, pixelBytes);
+		const __m128i current = LoadPixel(row + i, pixelBytes);
 
-			unsigned char r = static_cast<unsigned char>(R);
+		// avg_epu8 rounds up, the filter rounds down.
+		const __m128i average = _mm_sub_epi8(_mm_avg_epu8(left, above), _mm_and_si128(_mm_xor_si128(left, above), one));
+		left = _mm_add_epi8(current, average);
 
-			buffer[pixelIndex++] = r;
-		}
+		StorePixel(row + i, left, pixelBytes);
 	}
 }
 
-void ImageLoader::LoadPixels(std::vector<unsigned char>& buffer) const
+static void UnfilterPaethSSE2(uint8_t* row, const uint8_t* previous, size_t size, size_t pixelBytes)
 {
-	size_t H = info.startOfFrameInfo.width / data.MCUCount.x();
-	size_t V = info.startOfFrameInfo.height / data.MCUCount.y();
-	size_t C = (info.greyScale ? 1 : 4);
-
-	buffer.resize((info.startOfFrameInfo.width * info.startOfFrameInfo.height) * C);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i left = zero;
+	__m128i upperLeft = zero;
 
-	for (size_t y = 0; y < data.MCUCount.y(); y++)
+	for (size_t i = 0; i < size; i += pixelBytes)
 	{
-		for (size_t x = 0; x < data.MCUCount.x(); x++)
-		{
-			//std::array<unsigned char, (H * V) * C> blockPixels{};
-			std::vector<unsigned char> blockPixels((H * V) * C);
+		const __m128i above = _mm_unpacklo_epi8(LoadPixel(previous + i, pixelBytes), zero);
+		const __m128i current = LoadPixel(row + i, pixelBytes);
 
-			if (info.greyScale) LoadBlockGreyscale(blockPixels, y * data.MCUCount.x() + x);
-			else LoadBlock(blockPixels, y * data.MCUCount.x() + x);
+		__m128i pa = _mm_sub_epi16(above, upperLeft);
+		__m128i pb = _mm_sub_epi16(left, upperLeft);
+		__m128i pc = _mm_add_epi16(pa, pb);
 
-			for (size_t by = 0; by < V; by++)
-			{
-				for (size_t bx = 0; bx < H; bx++)
-				{
+		pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+		pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+		pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
 
-					size_t bufferIndex = (y * H + by) * info.startOfFrameInfo.width * C + (x * V + bx) * C;
-					size_t blockIndex = by * H * C + bx * C;
+		const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		const __m128i useLeft = _mm_cmpeq_epi16(smallest, pa);
+		const __m128i useAbove = _mm_andnot_si128(useLeft, _mm_cmpeq_epi16(smallest, pb));
+		const __m128i useUpperLeft = _mm_andnot_si128(_mm_or_si128(useLeft, useAbove), _mm_set1_epi16(-1));
 
-					for (size_t i = 0; i < C; i++) { buffer[bufferIndex++] = blockPixels[blockIndex++]; }
-				}
-			}
-		}
+		__m128i predictor = _mm_and_si128(useLeft, left);
+		predictor = _mm_or_si128(predictor, _mm_and_si128(useAbove, above));
+		predictor = _mm_or_si128(predictor, _mm_and_si128(useUpperLeft, upperLeft));
+
+		const __m128i result = _mm_add_epi8(current, _mm_packus_epi16(predictor, predictor));
+		StorePixel(row + i, result, pixelBytes);
+
+		left = _mm_unpacklo_epi8(result, zero);
+		upperLeft = above;
 	}
 }
+#endif
 
-void LoadBlockGreyscaleThread(std::vector<unsigned char>& buffer, const ImageData* data, size_t offset)
+static void UnfilterRow(uint8_t* row, const uint8_t* previous, size_t size, size_t pixelBytes, uint8_t filter)
 {
-	size_t pixelIndex = 0;
-
-	for (size_t y = 0; y < 8; y++)
+	switch (filter)
 	{
-		for (size_t x = 0; x < 8; x++)
+		case 0: return;
+		case 1:
+			for (size_t i = pixelBytes; i < size; i++) row[i] += row[i - pixelBytes];
+			return;
+		case 2:
 		{
-			double Y = static_cast<double>(data->blocks[offset][y * 8 + x]);
-
-			double R = Y;
+			size_t i = 0;
+#ifdef LOADER_SSE2
+			for (; i + 16 <= size; i += 16)
+			{
+				__m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+				__m128i above = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), _mm_add_epi8(current, above));
+			}
+#endif
+			for (; i < size; i++) row[i] += previous[i];
+			return;
+		}
+		case 3:
+#ifdef LOADER_SSE2
+			if (pixelBytes >= 3) return (UnfilterAverageSSE2(row, previous, size, pixelBytes));
+#endif
+			for (size_t i = 0; i < pixelBytes; i++) row[i] += previous[i] >> 1;
+			for (size_t i = pixelBytes; i < size; i++) row[i] += C8((row[i - pixelBytes] + previous[i]) >> 1);
+			return;
+		case 4:
+#ifdef LOADER_SSE2
+			if (pixelBytes >= 3) return (UnfilterPaethSSE2(row, previous, size, pixelBytes));
+#endif
+			for (size_t i = 0; i < pixelBytes; i++) row[i] += previous[i];
+			for (size_t i = pixelBytes; i < size; i++) row[i] += PaethPredictor(row[i - pixelBytes], previous[i], previous[i - pixelBytes]);
+			return;
+		default: throw (std::runtime_error("Invalid PNG filter"));
+	}
+}
 
-			if (R < 0) R = 0;
-			if (R > 255) R = 255;
+// Unfilters rows that each start with their filter byte, then packs them together without it.
+static void UnfilterRows(uint8_t* rows, size_t rowCount, size_t rowSize, size_t pixelBytes)
+{
+	const std::vector<uint8_t> zeros(rowSize, 0);
+	const uint8_t* previous = zeros.data();
 
-			unsigned char r = static_cast<unsigned char>(R);
+	for (size_t y = 0; y < rowCount; y++)
+	{
+		uint8_t* row = rows + y * (rowSize + 1);
+		UnfilterRow(row + 1, previous, rowSize, pixelBytes, row[0]);
 
-			buffer[pixelIndex++] = r;
-		}
+		std::memmove(rows + y * rowSize, row + 1, rowSize);
+		previous = rows + y * rowSize;
 	}
 }
 
-void LoadBlockThread(std::vector<unsigned char>& buffer, const ImageData* data, size_t offset)
+void ImageLoader::DecodePngData() const
 {
-	const size_t H = data->HVC.x();
-	const size_t V = data->HVC.y();
-	const size_t C = data->HVC.z();
-	const size_t P = data->subSamplePower;
+	double start = Time::GetCurrentTime();
+
+	const PNGInfo& png = info.pngInfo;
 
-	size_t pixelIndex = 0;
-	size_t blockIndex = 0;
+	// The zlib stream continues across IDAT chunks, split streams are gathered into one buffer.
+	std::vector<uint8_t> gathered;
+	const uint8_t* compressed = file.GetData() + png.dataChunks[0].first;
+	size_t compressedSize = png.dataChunks[0].second;
 
-	for (size_t y = 0; y < V; y++)
+	if (png.dataChunks.size() > 1)
 	{
-		for (size_t x = 0; x < H; x++)
+		for (const std::pair<size_t, size_t>& chunk : png.dataChunks)
 		{
-			int yi = y;
-			int xi = x;
-			int yci = y / P;
-			int xci = x / P;
-			if (y < 8 && x < 8)
-			{
-				blockIndex = 0;
-			}
-			else if (y < 8 && x >= 8)
-			{
-				blockIndex = 1;
-				xi -= 8;
-			}
-			else if (y >= 8 && x < 8)
-			{
-				blockIndex = 2;
-				yi -= 8;
-			}
-			else
-			{
-				blockIndex = 3;
-				xi -= 8;
-				yi -= 8;
-			}
+			gathered.insert(gathered.end(), file.GetData() + chunk.first, file.GetData() + chunk.first + chunk.second);
+		}
 
-			double Y = static_cast<double>(data->blocks[blockIndex + ((P * P + 2) * offset)][yi * 8 + xi]);
-			double Cb = static_cast<double>(data->blocks[(P * P) + ((P * P + 2) * offset)][yci * 8 + xci]);
-			double Cr = static_cast<double>(data->blocks[(P * P) + 1 + ((P * P + 2) * offset)][yci * 8 + xci]);
+		compressed = gathered.data();
+		compressedSize = gathered.size();
+	}
 
-			double R = (Y + 1.402 * (Cr - 128));
-			double G = (Y - 0.344136 * (Cb - 128) - 0.714136 * (Cr - 128));
-			double B = (Y + 1.772 * (Cb - 128));
+	const size_t bitsPerPixel = PngSamples(png.colorType) * png.bitDepth;
+	const size_t pixelBytes = std::max(CST(1), bitsPerPixel / 8);
+	data.scanlineSize = (png.width * bitsPerPixel + 7) / 8;
 
-			if (R < 0) R = 0;
-			if (R > 255) R = 255;
-			if (G < 0) G = 0;
-			if (G > 255) G = 255;
-			if (B < 0) B = 0;
-			if (B > 255) B = 255;
+	std::vector<std::array<size_t, 4>> passes = {{0, 0, 1, 1}};
+	if (png.interlace) passes.assign(adam7Passes.begin(), adam7Passes.end());
 
-			unsigned char r = static_cast<unsigned char>(R);
-			unsigned char g = static_cast<unsigned char>(G);
-			unsigned char b = static_cast<unsigned char>(B);
+	size_t inflatedSize = 0;
+	for (const std::array<size_t, 4>& pass : passes)
+	{
+		const size_t width = (png.width + pass[2] - pass[0] - 1) / pass[2];
+		const size_t height = (png.height + pass[3] - pass[1] - 1) / pass[3];
+		if (width && height) inflatedSize += height * (1 + (width * bitsPerPixel + 7) / 8);
+	}
 
-			buffer[pixelIndex++] = r;
-			buffer[pixelIndex++] = g;
+	std::vector<uint8_t> inflated(inflatedSize);
+	Inflater(compressed, compressedSize).Inflate(inflated.data(), inflated.size());
 
-			if (!data->normalMap)
-			{
-				buffer[pixelIndex++] = b;
-				buffer[pixelIndex++] = 255;
+	if (!png.interlace)
+	{
+		UnfilterRows(inflated.data(), png.height, data.scanlineSize, pixelBytes);
+		inflated.resize(png.height * data.scanlineSize);
+		data.scanlines = std::move(inflated);
+	}
+	else
+	{
+		data.scanlines.assign(png.height * data.scanlineSize, 0);
+		uint8_t* passData = inflated.data();
+
+		for (const std::array<size_t, 4>& pass : passes)
+		{
+			const size_t width = (png.width + pass[2] - pass[0] - 1) / pass[2];
+			const size_t height = (png.height + pass[3] - pass[1] - 1) / pass[3];
+			if (!width || !height) continue;
+
+			const size_t passRowSize = (width * bitsPerPixel + 7) / 8;
+			UnfilterRows(passData, height, passRowSize, pixelBytes);
+
+			for (size_t y = 0; y < height; y++)
+			{
+				const uint8_t* source = passData + y * passRowSize;
+				uint8_t* destination = data.scanlines.data() + (pass[1] + y * pass[3]) * data.scanlineSize;
+
+				for (size_t x = 0; x < width; x++)
+				{
+					const size_t target = pass[0] + x * pass[2];
+
+					if (bitsPerPixel >= 8)
+					{
+						std::memcpy(destination + target * pixelBytes, source + x * pixelBytes, pixelBytes);
+						continue;
+					}
+
+					const size_t mask = (CST(1) << bitsPerPixel) - 1;
+					const size_t value = (source[x * bitsPerPixel / 8] >> (8 - bitsPerPixel - (x * bitsPerPixel) % 8)) & mask;
+					destination[target * bitsPerPixel / 8] |= C8(value << (8 - bitsPerPixel - (target * bitsPerPixel) % 8));
+				}
 			}
+
+			passData += height * (1 + passRowSize);
 		}
 	}
+
+	std::cout << info.name << " loaded in: " << (Time::GetCurrentTime() - start) * 1000 << " ms. With a total size of: " << data.scanlines.size() / 1000000.0 << " mb." << std::endl;
 }
 
-void LoadPixelThread(std::vector<unsigned char>& buffer, const ImageData* data, size_t start, size_t end)
+void ImageLoader::BuildHuffmanTable(const std::vector<HuffmanCode>& codes, HuffmanTable& table) const
 {
-	const size_t H = data->HVC.x();
-	const size_t V = data->HVC.y();
-	const size_t C = data->HVC.z();
-	const size_t CI = data->normalMap ? 2 : C;
+	if (codes.size() > table.symbols.size()) throw (std::runtime_error("Too many huffman codes"));
 
-	for (size_t y = start; y < end; y++)
+	table.maxCode.fill(-1);
+	table.valueOffset.fill(0);
+	table.lookup.fill(HuffmanEntry{});
+
+	for (size_t i = 0; i < codes.size(); i++)
 	{
-		for (size_t x = 0; x < data->MCUCount.x(); x++)
+		const HuffmanCode& code = codes[i];
+		table.symbols[i] = code.symbol;
+
+		if (table.maxCode[code.length] == -1) table.valueOffset[code.length] = CI(i) - CI(code.code);
+		table.maxCode[code.length] = code.code;
+
+		if (code.length > FAST_BITS) continue;
+
+		const int shift = FAST_BITS - code.length;
+		const int base = code.code << shift;
+		const int size = code.symbol & 0x0F;
+
+		for (int r = 0; r < (1 << shift); r++)
 		{
-			std::vector<unsigned char> blockPixels((H * V) * CI);
-			if (C == 1) LoadBlockGreyscaleThread(blockPixels, data, y * data->MCUCount.x() + x);
-			else LoadBlockThread(blockPixels, data, y * data->MCUCount.x() + x);
+			HuffmanEntry& entry = table.lookup[base + r];
+			entry.symbol = code.symbol;
+			entry.codeLength = code.length;
 
-			for (size_t by = 0; by < V; by++)
+			if (size == 0)
 			{
-				for (size_t bx = 0; bx < H; bx++)
-				{
-					size_t bufferIndex = (y * V + by) * data->dimensions.x() * CI + (x * H + bx) * CI;
-					size_t blockIndex = by * H * CI + bx * CI;
+				entry.totalLength = code.length;
+			}
+			else if (code.length + size <= FAST_BITS)
+			{
+				int bits = (r >> (shift - size)) & ((1 << size) - 1);
+				entry.value = C16(EntropyReader::Extend(bits, size));
+				entry.totalLength = code.length + size;
+			}
+		}
+	}
 
-					for (size_t i = 0; i < CI; i++) { buffer[bufferIndex++] = blockPixels[blockIndex++]; }
+	table.maxCode[17] = 0x7FFFFFFF;
+}
+
+/*DataBlock ImageLoader::IDCTBlock(const DataBlock& input)
+{
+	DataBlock result{};
+
+	for (int y = 0; y < 8; y++)
+	{
+		for (int x = 0; x < 8; x++)
+		{
+			float sum = 0;
+
+			for (int v = 0; v < 8; v++)
+			{
+				for (int u = 0; u < 8; u++)
+				{
+					float AU = (u == 0) ? sqrt12 : 1;
+					float AV = (v == 0) ? sqrt12 : 1;
+					sum += AU * AV * input[v * 8 + u] * 
+						cos(((2 * x + 1) * u * M_PI) / 16.0) * 
+						cos(((2 * y + 1) * v * M_PI) / 16.0);
 				}
 			}
+
+			int16_t intSum = static_cast<int16_t>(sum * 0.25);
+			intSum += 128;
+			if (intSum < 0) intSum = 0;
+			if (intSum > 255) intSum = 255;
+
+			result[y * 8 + x] = intSum;
 		}
 	}
+
+	return (result);
+}*/
+
+#define FIX(x) static_cast<int>((x) * 4096 + 0.5)
+
+static const int idctEven0 = FIX(0.5411961);
+static const int idctEven1 = FIX(0.5411961 - 1.847759065);
+static const int idctEven2 = FIX(0.5411961 + 0.765366865);
+static const int idctOdd0 = FIX(0.298631336 - 0.899976223);
+static const int idctOdd1 = FIX(-0.899976223);
+static const int idctOdd2 = FIX(1.501321110 - 0.899976223);
+static const int idctOdd3 = FIX(2.053119869 - 2.562915447);
+static const int idctOdd4 = FIX(-2.562915447);
+static const int idctOdd5 = FIX(3.072711026 - 2.562915447);
+static const int idctOdd6 = FIX(1.175875602 - 1.961570560);
+static const int idctOdd7 = FIX(1.175875602);
+static const int idctOdd8 = FIX(1.175875602 - 0.390180644);
+
+static const int idctColumnShift = 10;
+static const int idctColumnBias = 1 << (idctColumnShift - 1);
+static const int idctRowShift = 17;
+static const int idctRowBias = (1 << (idctRowShift - 1)) + (128 << idctRowShift);
+
+// Loeffler-Ligtenberg-Moschytz 1D IDCT in 12-bit fixed point, the odd part rotations are
+// grouped in pairs so the scalar and SSE2 kernels share the same constants and rounding.
+static inline void IDCT1D(const int* in, int* out, int bias, int shift)
+{
+	const int even2 = in[2] * idctEven0 + in[6] * idctEven1;
+	const int even3 = in[2] * idctEven2 + in[6] * idctEven0;
+	const int even0 = (in[0] + in[4]) * 4096;
+	const int even1 = (in[0] - in[4]) * 4096;
+
+	const int x0 = even0 + even3 + bias;
+	const int x3 = even0 - even3 + bias;
+	const int x1 = even1 + even2 + bias;
+	const int x2 = even1 - even2 + bias;
+
+	const int y0 = in[7] + in[3];
+	const int y1 = in[5] + in[1];
+	const int a = y0 * idctOdd6 + y1 * idctOdd7;
+	const int b = y0 * idctOdd7 + y1 * idctOdd8;
+
+	const int t0 = in[7] * idctOdd0 + in[1] * idctOdd1 + a;
+	const int t3 = in[7] * idctOdd1 + in[1] * idctOdd2 + b;
+	const int t1 = in[5] * idctOdd3 + in[3] * idctOdd4 + b;
+	const int t2 = in[5] * idctOdd4 + in[3] * idctOdd5 + a;
+
+	out[0] = (x0 + t3) >> shift;
+	out[7] = (x0 - t3) >> shift;
+	out[1] = (x1 + t2) >> shift;
+	out[6] = (x1 - t2) >> shift;
+	out[2] = (x2 + t1) >> shift;
+	out[5] = (x2 - t1) >> shift;
+	out[3] = (x3 + t0) >> shift;
+	out[4] = (x3 - t0) >> shift;
 }
 
-void ImageLoader::LoadPixelsThreaded(std::vector<unsigned char>& buffer) const
+// Same transform as IDCT1D for inputs whose last four coefficients are zero.
+static inline void IDCT1DHalf(const int* in, int* out, int bias, int shift)
+{
+	const int even2 = in[2] * idctEven0;
+	const int even3 = in[2] * idctEven2;
+	const int even0 = in[0] * 4096;
+
+	const int x0 = even0 + even3 + bias;
+	const int x3 = even0 - even3 + bias;
+	const int x1 = even0 + even2 + bias;
+	const int x2 = even0 - even2 + bias;
+
+	const int a = in[3] * idctOdd6 + in[1] * idctOdd7;
+	const int b = in[3] * idctOdd7 + in[1] * idctOdd8;
+
+	const int t0 = in[1] * idctOdd1 + a;
+	const int t3 = in[1] * idctOdd2 + b;
+	const int t1 = in[3] * idctOdd4 + b;
+	const int t2 = in[3] * idctOdd5 + a;
+
+	out[0] = (x0 + t3) >> shift;
+	out[7] = (x0 - t3) >> shift;
+	out[1] = (x1 + t2) >> shift;
+	out[6] = (x1 - t2) >> shift;
+	out[2] = (x2 + t1) >> shift;
+	out[5] = (x2 - t1) >> shift;
+	out[3] = (x3 + t0) >> shift;
+	out[4] = (x3 - t0) >> shift;
+}
+
+// A block without AC coefficients transforms to a constant, this matches the rounding of the full IDCT.
+static void IDCTBlockDC(DataBlock& block, const QuantizationTable& quantization)
+{
+	const int value = ((block[0] * quantization[0] + 4) >> 3) + 128;
+
+	block.fill(static_cast<int16_t>(std::clamp(value, 0, 255)));
+}
+
+/**
+ * @brief Scaled IDCT producing an N x N block from the lowest N x N coefficients.
+ *
+ * @details
+ * Uses the N-point cosine basis with the normalization of the 8-point transform, so every output
+ * sample approximates the average of the 8 / N x 8 / N full resolution samples it covers. The
+ * result is stored in the top left corner of the block with the usual row stride of 8.
+ */
+template <size_t N>
+static void IDCTBlockReduced(DataBlock& block, const QuantizationTable& quantization)
 {
-	buffer.resize((data.dimensions.x() * data.dimensions.y()) * (data.normalMap ? 2 : data.HVC.z()));
+	static const std::array<int, N * N> basis = []()
+	{
+		std::array<int, N * N> result{};
+		for (size_t x = 0; x < N; x++)
+		{
+			for (size_t u = 0; u < N; u++)
+			{
+				const double scale = (u == 0 ? sqrt12 : 1.0) * 0.5;
+				result[x * N + u] = CI(std::lround(scale * std::cos((2.0 * x + 1.0) * u * M_PI / (2.0 * N)) * 4096.0));
+			}
+		}
+		return (result);
+	}();
+
+	int64_t temp[N * N];
+
+	for (size_t u = 0; u < N; u++)
+	{
+		for (size_t y = 0; y < N; y++)
+		{
+			int64_t sum = 0;
+			for (size_t v = 0; v < N; v++) sum += basis[y * N + v] * (block[v * 8 + u] * quantization[v * 8 + u]);
+			temp[y * N + u] = sum;
+		}
+	}
 
-	size_t threadCount = 8;
-	size_t threadLoad = data.MCUCount.y() / threadCount;
+	for (size_t y = 0; y < N; y++)
+	{
+		for (size_t x = 0; x < N; x++)
+		{
+			int64_t sum = (int64_t(128) << 24) + (int64_t(1) << 23);
+			for (size_t u = 0; u < N; u++) sum += basis[x * N + u] * temp[y * N + u];
+			block[y * 8 + x] = static_cast<int16_t>(std::clamp(int(sum >> 24), 0, 255));
+		}
+	}
+}
 
-	std::vector<std::future<void>> threads(threadCount);
+#ifndef LOADER_SSE2
+// Blocks ending before zigzag index 10 only have coefficients in their top left 4x4 corner.
+static void IDCTBlock4x4(DataBlock& block, const QuantizationTable& quantization)
+{
+	int temp[64]{};
+	int column[4];
+	int result[8];
 
-	for (size_t i = 0; i < threadCount; i++)
+	for (int x = 0; x < 4; x++)
 	{
-		threads[i] = std::async(LoadPixelThread, std::ref(buffer), &data, i * threadLoad, (i + 1) * threadLoad);
+		for (int y = 0; y < 4; y++) column[y] = block[y * 8 + x] * quantization[y * 8 + x];
+
+		if (column[1] == 0 && column[2] == 0 && column[3] == 0)
+		{
+			for (int y = 0; y < 8; y++) temp[y * 8 + x] = column[0] * 4;
+			continue;
+		}
+
+		IDCT1DHalf(column, result, idctColumnBias, idctColumnShift);
+		for (int y = 0; y < 8; y++) temp[y * 8 + x] = result[y];
 	}
 
-	for (size_t i = 0; i < threads.size(); i++)
+	for (int y = 0; y < 8; y++)
 	{
-		threads[i].wait();
+		IDCT1DHalf(&temp[y * 8], result, idctRowBias, idctRowShift);
+		for (int x = 0; x < 8; x++) block[y * 8 + x] = static_cast<int16_t>(std::clamp(result[x], 0, 255));
 	}
 }
 
-uint16_t PackRGB565(uint8_t r, uint8_t g, uint8_t b)
+static void IDCTBlockScalar(DataBlock& block, const QuantizationTable& quantization)
 {
-	uint16_t R = (uint16_t)((r * 31 + 127) / 255);
-	uint16_t G = (uint16_t)((g * 63 + 127) / 255);
-	uint16_t B = (uint16_t)((b * 31 + 127) / 255);
-	return (uint16_t)((R << 11) | (G << 5) | B);
+	int temp[64];
+	int column[8];
+	int result[8];
+
+	for (int x = 0; x < 8; x++)
+	{
+		bool acZero = true;
+		for (int y = 0; y < 8; y++)
+		{
+			column[y] = block[y * 8 + x] * quantization[y * 8 + x];
+			if (y > 0 && column[y] != 0) acZero = false;
+		}
+
+		if (acZero)
+		{
+			for (int y = 0; y < 8; y++) temp[y * 8 + x] = column[0] * 4;
+			continue;
+		}
+
+		IDCT1D(column, result, idctColumnBias, idctColumnShift);
+		for (int y = 0; y < 8; y++) temp[y * 8 + x] = result[y];
+	}
+
+	for (int y = 0; y < 8; y++)
+	{
+		IDCT1D(&temp[y * 8], result, idctRowBias, idctRowShift);
+		for (int x = 0; x < 8; x++) block[y * 8 + x] = static_cast<int16_t>(std::clamp(result[x], 0, 255));
+	}
 }
+#endif
 
-Point<uint8_t, 3> UnpackRGB565(uint16_t c)
+#ifdef LOADER_SSE2
+static inline void TransposeSSE2(__m128i* rows)
 {
-	uint8_t R5 = (c >> 11) & 31;
-	uint8_t G6 = (c >> 5) & 63;
-	uint8_t B5 = c & 31;
+	__m128i a0 = _mm_unpacklo_epi16(rows[0], rows[1]);
+	__m128i a1 = _mm_unpackhi_epi16(rows[0], rows[1]);
+	__m128i a2 = _mm_unpacklo_epi16(rows[2], rows[3]);
+	__m128i a3 = _mm_unpackhi_epi16(rows[2], rows[3]);
+	__m128i a4 = _mm_unpacklo_epi16(rows[4], rows[5]);
+	__m128i a5 = _mm_unpackhi_epi16(rows[4], rows[5]);
+	__m128i a6 = _mm_unpacklo_epi16(rows[6], rows[7]);
+	__m128i a7 = _mm_unpackhi_epi16(rows[6], rows[7]);
+
+	__m128i b0 = _mm_unpacklo_epi32(a0, a2);
+	__m128i b1 = _mm_unpackhi_epi32(a0, a2);
+	__m128i b2 = _mm_unpacklo_epi32(a1, a3);
+	__m128i b3 = _mm_unpackhi_epi32(a1, a3);
+	__m128i b4 = _mm_unpacklo_epi32(a4, a6);
+	__m128i b5 = _mm_unpackhi_epi32(a4, a6);
+	__m128i b6 = _mm_unpacklo_epi32(a5, a7);
+	__m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+	rows[0] = _mm_unpacklo_epi64(b0, b4);
+	rows[1] = _mm_unpackhi_epi64(b0, b4);
+	rows[2] = _mm_unpacklo_epi64(b1, b5);
+	rows[3] = _mm_unpackhi_epi64(b1, b5);
+	rows[4] = _mm_unpacklo_epi64(b2, b6);
+	rows[5] = _mm_unpackhi_epi64(b2, b6);
+	rows[6] = _mm_unpacklo_epi64(b3, b7);
+	rows[7] = _mm_unpackhi_epi64(b3, b7);
+}
 
-	Point<uint8_t, 3> rgb{};
-	rgb.x() = (uint8_t)((R5 << 3) | (R5 >> 2));
-	rgb.y() = (uint8_t)((G6 << 2) | (G6 >> 4));
-	rgb.z() = (uint8_t)((B5 << 3) | (B5 >> 2));
+static inline __m128i PairSSE2(int a, int b)
+{
+	return (_mm_set_epi16(C16(b), C16(a), C16(b), C16(a), C16(b), C16(a), C16(b), C16(a)));
+}
 
-	return (rgb);
+// Computes a * x + b * y for interleaved 16-bit pairs, returning the low and high 32-bit halves.
+static inline void RotateSSE2(__m128i x, __m128i y, __m128i constants, __m128i& low, __m128i& high)
+{
+	low = _mm_madd_epi16(_mm_unpacklo_epi16(x, y), constants);
+	high = _mm_madd_epi16(_mm_unpackhi_epi16(x, y), constants);
 }
 
-uint32_t RGBError(Point<uint8_t, 3> rgb0, Point<uint8_t, 3> rgb1)
+// Transforms eight rows in parallel, one lane per column.
+static inline void IDCT1DSSE2(__m128i* rows, int bias, int shift)
 {
-	int dr = int(rgb0.x()) - int(rgb1.x());
-    int dg = int(rgb0.y()) - int(rgb1.y());
-    int db = int(rgb0.z()) - int(rgb1.z());
-    // Weights ~ (3,6,1). Tweak to taste.
-    return uint32_t(3*dr*dr + 6*dg*dg + 1*db*db);
+	const __m128i biasValue = _mm_set1_epi32(bias);
+	const __m128i zero = _mm_setzero_si128();
+
+	__m128i even2Low, even2High, even3Low, even3High;
+	RotateSSE2(rows[2], rows[6], PairSSE2(idctEven0, idctEven1), even2Low, even2High);
+	RotateSSE2(rows[2], rows[6], PairSSE2(idctEven2, idctEven0), even3Low, even3High);
+
+	const __m128i sum04 = _mm_add_epi16(rows[0], rows[4]);
+	const __m128i difference04 = _mm_sub_epi16(rows[0], rows[4]);
+	const __m128i even0Low = _mm_srai_epi32(_mm_unpacklo_epi16(zero, sum04), 4);
+	const __m128i even0High = _mm_srai_epi32(_mm_unpackhi_epi16(zero, sum04), 4);
+	const __m128i even1Low = _mm_srai_epi32(_mm_unpacklo_epi16(zero, difference04), 4);
+	const __m128i even1High = _mm_srai_epi32(_mm_unpackhi_epi16(zero, difference04), 4);
+
+	const __m128i x0Low = _mm_add_epi32(_mm_add_epi32(even0Low, even3Low), biasValue);
+	const __m128i x0High = _mm_add_epi32(_mm_add_epi32(even0High, even3High), biasValue);
+	const __m128i x3Low = _mm_add_epi32(_mm_sub_epi32(even0Low, even3Low), biasValue);
+	const __m128i x3High = _mm_add_epi32(_mm_sub_epi32(even0High, even3High), biasValue);
+	const __m128i x1Low = _mm_add_epi32(_mm_add_epi32(even1Low, even2Low), biasValue);
+	const __m128i x1High = _mm_add_epi32(_mm_add_epi32(even1High, even2High), biasValue);
+	const __m128i x2Low = _mm_add_epi32(_mm_sub_epi32(even1Low, even2Low), biasValue);
+	const __m128i x2High = _mm_add_epi32(_mm_sub_epi32(even1High, even2High), biasValue);
+
+	const __m128i y0 = _mm_add_epi16(rows[7], rows[3]);
+	const __m128i y1 = _mm_add_epi16(rows[5], rows[1]);
+
+	__m128i aLow, aHigh, bLow, bHigh;
+	RotateSSE2(y0, y1, PairSSE2(idctOdd6, idctOdd7), aLow, aHigh);
+	RotateSSE2(y0, y1, PairSSE2(idctOdd7, idctOdd8), bLow, bHigh);
+
+	__m128i t0Low, t0High, t1Low, t1High, t2Low, t2High, t3Low, t3High;
+	RotateSSE2(rows[7], rows[1], PairSSE2(idctOdd0, idctOdd1), t0Low, t0High);
+	RotateSSE2(rows[7], rows[1], PairSSE2(idctOdd1, idctOdd2), t3Low, t3High);
+	RotateSSE2(rows[5], rows[3], PairSSE2(idctOdd3, idctOdd4), t1Low, t1High);
+	RotateSSE2(rows[5], rows[3], PairSSE2(idctOdd4, idctOdd5), t2Low, t2High);
+
+	t0Low = _mm_add_epi32(t0Low, aLow);
+	t0High = _mm_add_epi32(t0High, aHigh);
+	t3Low = _mm_add_epi32(t3Low, bLow);
+	t3High = _mm_add_epi32(t3High, bHigh);
+	t1Low = _mm_add_epi32(t1Low, bLow);
+	t1High = _mm_add_epi32(t1High, bHigh);
+	t2Low = _mm_add_epi32(t2Low, aLow);
+	t2High = _mm_add_epi32(t2High, aHigh);
+
+	auto output = [shift](__m128i xLow, __m128i xHigh, __m128i tLow, __m128i tHigh, __m128i& sum, __m128i& difference)
+	{
+		sum = _mm_packs_epi32(_mm_sra_epi32(_mm_add_epi32(xLow, tLow), _mm_cvtsi32_si128(shift)),
+			_mm_sra_epi32(_mm_add_epi32(xHigh, tHigh), _mm_cvtsi32_si128(shift)));
+		difference = _mm_packs_epi32(_mm_sra_epi32(_mm_sub_epi32(xLow, tLow), _mm_cvtsi32_si128(shift)),
+			_mm_sra_epi32(_mm_sub_epi32(xHigh, tHigh), _mm_cvtsi32_si128(shift)));
+	};
+
+	output(x0Low, x0High, t3Low, t3High, rows[0], rows[7]);
+	output(x1Low, x1High, t2Low, t2High, rows[1], rows[6]);
+	output(x2Low, x2High, t1Low, t1High, rows[2], rows[5]);
+	output(x3Low, x3High, t0Low, t0High, rows[3], rows[4]);
 }
 
-Point<uint8_t, 3> LoadRGBClamped(unsigned char* pixels, Point<int, 2> xy, Point<int, 3> whs)
+// Same transform as IDCT1DSSE2 for rows 4 to 7 being zero, the even and odd terms are folded into single rotations.
+static inline void IDCT1DHalfSSE2(__m128i* rows, int bias, int shift)
 {
-	int x = std::min(whs.x() - 1, std::max(0, xy.x()));
-	int y = std::min(whs.y() - 1, std::max(0, xy.y()));
+	const __m128i biasValue = _mm_set1_epi32(bias);
 
-	int offset = y * whs.z() + x * 4;
-	
-	Point<uint8_t, 3> rgb{};
-	rgb.x() = pixels[offset];
-	rgb.y() = pixels[offset + 1];
-	rgb.z() = pixels[offset + 2];
+	__m128i x0Low, x0High, x1Low, x1High, x2Low, x2High, x3Low, x3High;
+	RotateSSE2(rows[2], rows[0], PairSSE2(idctEven2, 4096), x0Low, x0High);
+	RotateSSE2(rows[2], rows[0], PairSSE2(-idctEven2, 4096), x3Low, x3High);
+	RotateSSE2(rows[2], rows[0], PairSSE2(idctEven0, 4096), x1Low, x1High);
+	RotateSSE2(rows[2], rows[0], PairSSE2(-idctEven0, 4096), x2Low, x2High);
 
-	return (rgb);
+	__m128i t0Low, t0High, t1Low, t1High, t2Low, t2High, t3Low, t3High;
+	RotateSSE2(rows[3], rows[1], PairSSE2(idctOdd6, idctOdd1 + idctOdd7), t0Low, t0High);
+	RotateSSE2(rows[3], rows[1], PairSSE2(idctOdd7, idctOdd2 + idctOdd8), t3Low, t3High);
+	RotateSSE2(rows[3], rows[1], PairSSE2(idctOdd4 + idctOdd7, idctOdd8), t1Low, t1High);
+	RotateSSE2(rows[3], rows[1], PairSSE2(idctOdd5 + idctOdd6, idctOdd7), t2Low, t2High);
+
+	auto output = [shift, biasValue](__m128i xLow, __m128i xHigh, __m128i tLow, __m128i tHigh, __m128i& sum, __m128i& difference)
+	{
+		xLow = _mm_add_epi32(xLow, biasValue);
+		xHigh = _mm_add_epi32(xHigh, biasValue);
+		sum = _mm_packs_epi32(_mm_sra_epi32(_mm_add_epi32(xLow, tLow), _mm_cvtsi32_si128(shift)),
+			_mm_sra_epi32(_mm_add_epi32(xHigh, tHigh), _mm_cvtsi32_si128(shift)));
+		difference = _mm_packs_epi32(_mm_sra_epi32(_mm_sub_epi32(xLow, tLow), _mm_cvtsi32_si128(shift)),
+			_mm_sra_epi32(_mm_sub_epi32(xHigh, tHigh), _mm_cvtsi32_si128(shift)));
+	};
+
+	output(x0Low, x0High, t3Low, t3High, rows[0], rows[7]);
+	output(x1Low, x1High, t2Low, t2High, rows[1], rows[6]);
+	output(x2Low, x2High, t1Low, t1High, rows[2], rows[5]);
+	output(x3Low, x3High, t0Low, t0High, rows[3], rows[4]);
 }
 
-void LoadCompressedBlockBC1(unsigned char* buffer, unsigned char* pixels, Point<int, 2> xy, Point<int, 3> whs)
+static void StoreBlockSSE2(DataBlock& block, const __m128i* rows)
 {
-	uint8_t block[16][3];
-	int idx = 0;
-	uint8_t rMin=255, gMin=255, bMin=255, rMax=0, gMax=0, bMax=0;
+	const __m128i minimum = _mm_setzero_si128();
+	const __m128i maximum = _mm_set1_epi16(255);
 
-	for (int dy = 0; dy < 4; dy++)
+	for (int i = 0; i < 8; i++)
 	{
-		for (int dx = 0; dx < 4; dx++, idx++)
+		const __m128i clamped = _mm_min_epi16(_mm_max_epi16(rows[i], minimum), maximum);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&block[i * 8]), clamped);
+	}
+}
+
+static void IDCTBlock4x4SSE2(DataBlock& block, const QuantizationTable& quantization)
+{
+	__m128i rows[8];
+
+	for (int i = 0; i < 4; i++)
+	{
+		const __m128i coefficients = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&block[i * 8]));
+		const __m128i factors = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&quantization[i * 8]));
+		rows[i] = _mm_mullo_epi16(coefficients, factors);
+	}
+
+	IDCT1DHalfSSE2(rows, idctColumnBias, idctColumnShift);
+	TransposeSSE2(rows);
+	IDCT1DHalfSSE2(rows, idctRowBias, idctRowShift);
+	TransposeSSE2(rows);
+	StoreBlockSSE2(block, rows);
+}
+
+static void IDCTBlockSSE2(DataBlock& block, const QuantizationTable& quantization)
+{
+	__m128i rows[8];
+
+	for (int i = 0; i < 8; i++)
+	{
+		const __m128i coefficients = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&block[i * 8]));
+		const __m128i factors = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&quantization[i * 8]));
+		rows[i] = _mm_mullo_epi16(coefficients, factors);
+	}
+
+	IDCT1DSSE2(rows, idctColumnBias, idctColumnShift);
+	TransposeSSE2(rows);
+	IDCT1DSSE2(rows, idctRowBias, idctRowShift);
+	TransposeSSE2(rows);
+	StoreBlockSSE2(block, rows);
+}
+#endif
+
+void ImageLoader::FIDCTBlock(DataBlock& block, const QuantizationTable& quantization, size_t end)
+{
+	if (end == 0) return (IDCTBlockDC(block, quantization));
+
+#ifdef LOADER_SSE2
+	if (end < 10) IDCTBlock4x4SSE2(block, quantization);
+	else IDCTBlockSSE2(block, quantization);
+#else
+	if (end < 10) IDCTBlock4x4(block, quantization);
+	else IDCTBlockScalar(block, quantization);
+#endif
+}
+
+const ImageInfo& ImageLoader::GetInfo() const
+{
+	return (info);
+}
+
+static double subTime = 0;
+static double addTime = 0;
+static double restTime = 0;
+
+// Returns the last huffman table of type with ID defined among the first count tables, later tables replace earlier ones.
+static size_t FindHuffmanTable(const ImageInfo& info, size_t type, size_t ID, size_t count)
+{
+	for (size_t i = std::min(count, info.huffmanInfos.size()); i > 0; i--)
+	{
+		if (info.huffmanInfos[i - 1].type == type && info.huffmanInfos[i - 1].ID == ID) return (i - 1);
+	}
+
+	throw (std::runtime_error("No valid tables found"));
+}
+
+void ImageLoader::PrepareData() const
+{
+	size_t totalBlockCount = 0;
+	size_t maxH = 0;
+	size_t maxV = 0;
+	for (const Point<size_t, 4>& component : info.startOfFrameInfo.components)
+	{
+		totalBlockCount += component.y() * component.z();
+		maxH = std::max(maxH, component.y());
+		maxV = std::max(maxV, component.z());
+	}
+	data.MCUCount.x() = (info.startOfFrameInfo.width + maxH * 8 - 1) / (maxH * 8);
+	data.MCUCount.y() = (info.startOfFrameInfo.height + maxV * 8 - 1) / (maxV * 8);
+	data.MCUCount.z() = data.MCUCount.x() * data.MCUCount.y();
+	data.maxHV.x() = maxH;
+	data.maxHV.y() = maxV;
+	data.blockSize = CST(8) >> std::min(config.scaleLevel, CST(3));
+	data.dimensions.x() = (info.startOfFrameInfo.width * data.blockSize + 7) / 8;
+	data.dimensions.y() = (info.startOfFrameInfo.height * data.blockSize + 7) / 8;
+	data.dimensions.z() = 1;
+	data.MCUBlockCount = totalBlockCount;
+	data.restartInterval = info.startOfScanInfo.restartInterval;
+	data.fancyUpsampling = config.fancyUpsampling;
+	size_t H = maxH * data.blockSize;
+	size_t V = maxV * data.blockSize;
+	size_t C = (info.greyScale ? 1 : 4);
+	data.HVC = {H, V, C};
+
+	//std::cout << info.name << " = " << data.HVC << std::endl;
+
+	//std::cout << "mcucount: " << data.MCUCount << std::endl; 
+
+	//double treeStart = Time::GetCurrentTime();
+
+	data.huffmanTables.resize(info.huffmanInfos.size());
+	for (size_t i = 0; i < data.huffmanTables.size(); i++)
+	{
+		BuildHuffmanTable(info.huffmanInfos[i].huffmanCodes, data.huffmanTables[i]);
+	}
+
+	//std::cout << "Trees build in: " << (Time::GetCurrentTime() - treeStart) * 1000 << std::endl;
+
+	// Scans list their components in frame order, so the blocks of an MCU follow the frame as well.
+	data.blockQuantization.clear();
+	data.layouts.clear();
+	for (const Point<size_t, 4>& component : info.startOfFrameInfo.components)
+	{
+		BlockLayout layout{component.y(), component.z(), data.blockQuantization.size()};
+
+		// Progressive scans select their own tables while decoding.
+		if (!info.progressive)
 		{
-			Point<int, 2> dxy(dx, dy);
-			Point<uint8_t, 3> rgb = LoadRGBClamped(pixels, xy + dxy, whs);
+			auto table = info.startOfScanInfo.componentTables.find(component.x());
+			if (table == info.startOfScanInfo.componentTables.end()) throw (std::runtime_error("Component missing from scan"));
 
-			block[idx][0] = rgb.x();
-			block[idx][1] = rgb.y();
-			block[idx][2] = rgb.z();
+			layout.DCTable = FindHuffmanTable(info, 0, table->second.first, info.startOfScanInfo.huffmanCount);
+			layout.ACTable = FindHuffmanTable(info, 1, table->second.second, info.startOfScanInfo.huffmanCount);
+		}
 
-			rMin = std::min(rMin, rgb.x()); gMin = std::min(gMin, rgb.y()); bMin = std::min(bMin, rgb.z());
-        	rMax = std::max(rMax, rgb.x()); gMax = std::max(gMax, rgb.y()); bMax = std::max(bMax, rgb.z());
+		const DQTInfo* quantizationTable = nullptr;
+		for (const DQTInfo& DQT : info.quantizationTables)
+		{
+			if (DQT.ID == component.w()) quantizationTable = &DQT;
 		}
+		if (!quantizationTable) throw (std::runtime_error("No valid quantization table found"));
+
+		for (size_t i = 0; i < component.y() * component.z(); i++) data.blockQuantization.push_back(quantizationTable->values);
+
+		data.layouts.push_back(layout);
 	}
+}
+
+// Makes room for the blocks of rows MCU rows, rows of the image are stored at their index modulo rows.
+static void AllocateBlocks(ImageData* data, size_t rows)
+{
+	data->residentRows = std::max(CST(1), std::min(rows, data->MCUCount.y()));
+	data->blocks.resize(data->residentRows * data->MCUCount.x() * data->MCUBlockCount);
+	data->blockEnds.resize(data->blocks.size());
+}
+
+static size_t FirstRowBlock(const ImageData* data, size_t MCURow)
+{
+	return ((MCURow % data->residentRows) * data->MCUCount.x() * data->MCUBlockCount);
+}
+
+// Entropy decodes count MCUs into the blocks reserved for their rows, a restart marker is expected before every interval.
+static void DecodeMCUs(ImageData* data, EntropyReader& er, std::vector<int>& DCs, size_t first, size_t count)
+{
+	for (size_t MCU = first; MCU < first + count; MCU++)
+	{
+		if (data->restartInterval && MCU != 0 && MCU % data->restartInterval == 0)
+		{
+			er.Restart();
+			std::fill(DCs.begin(), DCs.end(), 0);
+		}
+
+		size_t blockIndex = FirstRowBlock(data, MCU / data->MCUCount.x()) + (MCU % data->MCUCount.x()) * data->MCUBlockCount;
+
+		for (size_t componentIndex = 0; componentIndex < data->layouts.size(); componentIndex++)
+		{
+			const BlockLayout& layout = data->layouts[componentIndex];
+			const HuffmanTable& DCTable = data->huffmanTables[layout.DCTable];
+			const HuffmanTable& ACTable = data->huffmanTables[layout.ACTable];
 
-	uint16_t c0 = PackRGB565(rMax, gMax, bMax);
-	uint16_t c1 = PackRGB565(rMin, gMin, bMin);
+			size_t blockCount = layout.horizontal * layout.vertical;
+			for (size_t BI = 0; BI < blockCount; BI++)
+			{
+				DataBlock& block = data->blocks[blockIndex];
+				block.fill(0);
+				data->blockEnds[blockIndex] = 0;
+
+				DCs[componentIndex] += er.DecodeValue(DCTable).value;
+
+				block[0] = static_cast<int16_t>(DCs[componentIndex]);
+
+				size_t i = 1;
+				while (i < 64)
+				{
+					HuffmanValue AC = er.DecodeValue(ACTable);
+
+					if (AC.symbol == 0x00) break;
+					if (AC.symbol == 0xF0)
+					{
+						i += 16;
+						continue;
+					}
+
+					if ((AC.symbol & 0x0F) == 0) throw (std::runtime_error("size equals zero"));
+
+					i += AC.symbol >> 4;
 
-	if (c0 <= c1) {std::swap(c0, c1);}
+					if (i >= 64) throw (std::runtime_error("size run length: out of block bounds"));
 
-	Point<uint8_t, 3> p0rgb = UnpackRGB565(c0);
-	Point<uint8_t, 3> p1rgb = UnpackRGB565(c1);
+					block[zigzagTable[i]] = static_cast<int16_t>(AC.value);
+					data->blockEnds[blockIndex] = C8(i);
+					i++;
+				}
 
-	uint8_t p2r = (uint8_t)((2 * p0rgb.x() + p1rgb.x() + 1) / 3);
-	uint8_t p2g = (uint8_t)((2 * p0rgb.y() + p1rgb.y() + 1) / 3);
-	uint8_t p2b = (uint8_t)((2 * p0rgb.z() + p1rgb.z() + 1) / 3);
+				blockIndex++;
+			}
+		}
+	}
+}
 
-	uint8_t p3r = (uint8_t)((p0rgb.x() + 2 * p1rgb.x() + 1) / 3);
-	uint8_t p3g = (uint8_t)((p0rgb.y() + 2 * p1rgb.y() + 1) / 3);
-	uint8_t p3b = (uint8_t)((p0rgb.z() + 2 * p1rgb.z() + 1) / 3);
+// Returns the offsets of the restart markers in the scan starting at start.
+static std::vector<size_t> FindRestartMarkers(const uint8_t* rawData, size_t size, size_t start)
+{
+	std::vector<size_t> markers;
 
-	Point<uint8_t, 3> p2rgb(p2r, p2g, p2b);
-	Point<uint8_t, 3> p3rgb(p3r, p3g, p3b);
+	const uint8_t* position = rawData + start;
+	const uint8_t* end = rawData + size;
 
-	uint32_t indexBits = 0;
-	for (int i = 0; i < 16; i++)
+	while (position + 1 < end)
 	{
-		Point<uint8_t, 3> blockRGB(block[i][0], block[i][1], block[i][2]);
+		position = static_cast<const uint8_t*>(std::memchr(position, 0xFF, CST(end - position) - 1));
+		if (!position) break;
+
+		const uint8_t marker = position[1];
+		if (marker >= C8(ImageMarker::RST0) && marker <= C8(ImageMarker::RST7)) markers.push_back(CST(position - rawData));
+		else if (marker != 0x00 && marker != 0xFF) break;
+
+		position += 2;
+	}
+
+	return (markers);
+}
 
-		uint32_t e0 = RGBError(blockRGB, p0rgb);
-		uint32_t e1 = RGBError(blockRGB, p1rgb);
-		uint32_t e2 = RGBError(blockRGB, p2rgb);
-		uint32_t e3 = RGBError(blockRGB, p3rgb);
+// Decodes the restart intervals first to last, every interval after the first is read starting at its restart marker.
+static void DecodeRestartIntervals(ImageData* data, const uint8_t* rawData, const std::vector<size_t>& starts, size_t end, size_t first, size_t last)
+{
+	std::vector<int> DCs(data->layouts.size());
+
+	for (size_t i = first; i < last; i++)
+	{
+		const size_t intervalEnd = (i + 1 < starts.size() ? starts[i + 1] : end);
+		ByteReader br(rawData + starts[i], intervalEnd - starts[i]);
+		EntropyReader er(br);
 
-		uint32_t idx2 = 0;
-		uint32_t best = e0;
-		if (e1 < best) {best = e1; idx2 = 1;}
-        if (e2 < best) {best = e2; idx2 = 2;}
-        if (e3 < best) {best = e3; idx2 = 3;}
+		const size_t firstMCU = i * data->restartInterval;
+		const size_t count = std::min(data->restartInterval, data->MCUCount.z() - firstMCU);
 
-		indexBits |= (idx2 & 3) << (2 * i); // little-endian packing
+		std::fill(DCs.begin(), DCs.end(), 0);
+		DecodeMCUs(data, er, DCs, firstMCU, count);
 	}
+}
 
-	buffer[0] = (uint8_t)(c0 & 0xFF);
-	buffer[1] = (uint8_t)(c0 >> 8);
-	buffer[2] = (uint8_t)(c1 & 0xFF);
-	buffer[3] = (uint8_t)(c1 >> 8);
-	std::memcpy(buffer + 4, &indexBits, 4);
+/** @brief Decoding state of a progressive scan, reset at every restart marker. */
+struct ProgressiveState
+{
+	const SOSInfo* scan = nullptr;
+	std::vector<size_t> components;
+	std::vector<int> DCs;
+	size_t EOBRun = 0;
+};
+
+// Refines a coefficient that is already non-zero with the next correction bit.
+static void RefineCoefficient(EntropyReader& er, int16_t& coefficient, int bit)
+{
+	if (er.ReadBits(1) && (coefficient & bit) == 0) coefficient += (coefficient >= 0 ? bit : -bit);
 }
 
-std::array<uint8_t, 8> BuildBC4Palette(uint8_t a0, uint8_t a1)
+static void DecodeProgressiveBlock(ImageData* data, EntropyReader& er, ProgressiveState& state, size_t componentIndex, size_t blockIndex)
 {
-	std::array<uint8_t, 8> palette{};
-	palette[0] = a0;
-	palette[1] = a1;
+	const SOSInfo& scan = *state.scan;
+	const BlockLayout& layout = data->layouts[state.components[componentIndex]];
+	DataBlock& block = data->blocks[blockIndex];
+	const int bit = 1 << scan.approximationLow;
 
-	if (a0 > a1)
+	if (scan.spectralStart == 0)
 	{
-		palette[2] = (uint8_t)((6 * int(a0) + 1 * int(a1) + 3) / 7);
-		palette[3] = (uint8_t)((5 * int(a0) + 2 * int(a1) + 3) / 7);
-		palette[4] = (uint8_t)((4 * int(a0) + 3 * int(a1) + 3) / 7);
-		palette[5] = (uint8_t)((3 * int(a0) + 4 * int(a1) + 3) / 7);
-		palette[6] = (uint8_t)((2 * int(a0) + 5 * int(a1) + 3) / 7);
-		palette[7] = (uint8_t)((1 * int(a0) + 6 * int(a1) + 3) / 7);
+		if (scan.approximationHigh == 0)
+		{
+			state.DCs[componentIndex] += er.DecodeValue(data->huffmanTables[layout.DCTable]).value;
+			block[0] = static_cast<int16_t>(state.DCs[componentIndex] * bit);
+		}
+		else if (er.ReadBits(1))
+		{
+			block[0] |= static_cast<int16_t>(bit);
+		}
+
+		return;
+	}
+
+	const HuffmanTable& ACTable = data->huffmanTables[layout.ACTable];
+	size_t k = scan.spectralStart;
+
+	if (scan.approximationHigh == 0)
+	{
+		if (state.EOBRun > 0)
+		{
+			state.EOBRun--;
+			return;
+		}
+
+		for (; k <= scan.spectralEnd; k++)
+		{
+			HuffmanValue AC = er.DecodeValue(ACTable);
+			const size_t run = AC.symbol >> 4;
+
+			if ((AC.symbol & 0x0F) == 0)
+			{
+				if (run == 15)
+				{
+					k += 15;
+					continue;
+				}
+
+				state.EOBRun = (CST(1) << run) + CST(er.ReadBits(run)) - 1;
+				break;
+			}
+
+			k += run;
+			if (k > 63) throw (std::runtime_error("size run length: out of block bounds"));
+
+			block[zigzagTable[k]] = static_cast<int16_t>(AC.value * bit);
+		}
+
+		return;
+	}
+
+	// Successive approximation of the AC coefficients, every non-zero coefficient passed gets a correction bit.
+	if (state.EOBRun == 0)
+	{
+		for (; k <= scan.spectralEnd; k++)
+		{
+			HuffmanValue AC = er.DecodeValue(ACTable);
+			int run = AC.symbol >> 4;
+			int value = 0;
+
+			if ((AC.symbol & 0x0F) != 0)
+			{
+				value = (AC.value > 0 ? bit : -bit);
+			}
+			else if (run != 15)
+			{
+				state.EOBRun = (CST(1) << run) + CST(er.ReadBits(run));
+				break;
+			}
+
+			for (; k <= scan.spectralEnd; k++)
+			{
+				int16_t& coefficient = block[zigzagTable[k]];
+
+				if (coefficient != 0) RefineCoefficient(er, coefficient, bit);
+				else if (--run < 0) break;
+			}
+
+			if (value != 0 && k <= scan.spectralEnd) block[zigzagTable[k]] = static_cast<int16_t>(value);
+		}
+	}
+
+	if (state.EOBRun > 0)
+	{
+		for (; k <= scan.spectralEnd; k++)
+		{
+			int16_t& coefficient = block[zigzagTable[k]];
+
+			if (coefficient != 0) RefineCoefficient(er, coefficient, bit);
+		}
+
+		state.EOBRun--;
+	}
+}
+
+// Decodes one scan of a progressive image, adding its coefficients or correction bits to the blocks.
+static void DecodeProgressiveScan(ImageData* data, const ImageInfo& info, const SOSInfo& scan, const uint8_t* rawData, size_t size)
+{
+	ProgressiveState state{};
+	state.scan = &scan;
+
+	for (size_t i = 0; i < info.startOfFrameInfo.components.size(); i++)
+	{
+		auto table = scan.componentTables.find(info.startOfFrameInfo.components[i].x());
+		if (table == scan.componentTables.end()) continue;
+
+		BlockLayout& layout = data->layouts[i];
+		if (scan.spectralStart == 0 && scan.approximationHigh == 0) layout.DCTable = FindHuffmanTable(info, 0, table->second.first, scan.huffmanCount);
+		if (scan.spectralStart != 0) layout.ACTable = FindHuffmanTable(info, 1, table->second.second, scan.huffmanCount);
+
+		state.components.push_back(i);
+	}
+	state.DCs.resize(state.components.size());
+
+	if (state.components.empty()) throw (std::runtime_error("Scan without components"));
+	if (scan.spectralStart > scan.spectralEnd || scan.spectralEnd > 63) throw (std::runtime_error("Invalid spectral selection"));
+	if (scan.spectralStart != 0 && state.components.size() > 1) throw (std::runtime_error("Interleaved AC scan"));
+
+	ByteReader br(rawData, size);
+	br.Skip(scan.start + scan.length);
+	EntropyReader er(br);
+
+	// Encoders may define a different restart interval before every scan.
+	auto restart = [&scan, &er, &state](size_t MCU)
+	{
+		if (!scan.restartInterval || MCU == 0 || MCU % scan.restartInterval != 0) return;
+
+		er.Restart();
+		std::fill(state.DCs.begin(), state.DCs.end(), 0);
+		state.EOBRun = 0;
+	};
+
+	if (state.components.size() > 1)
+	{
+		for (size_t MCU = 0; MCU < data->MCUCount.z(); MCU++)
+		{
+			restart(MCU);
+
+			size_t blockIndex = FirstRowBlock(data, MCU / data->MCUCount.x()) + (MCU % data->MCUCount.x()) * data->MCUBlockCount;
+			for (size_t i = 0; i < state.components.size(); i++)
+			{
+				const BlockLayout& layout = data->layouts[state.components[i]];
+
+				for (size_t j = 0; j < layout.horizontal * layout.vertical; j++)
+				{
+					DecodeProgressiveBlock(data, er, state, i, blockIndex + layout.offset + j);
+				}
+			}
+		}
+
+		return;
+	}
+
+	// A scan of a single component covers only the blocks inside the component, one block per MCU.
+	const BlockLayout& layout = data->layouts[state.components[0]];
+	const size_t width = (info.startOfFrameInfo.width * layout.horizontal + data->maxHV.x() - 1) / data->maxHV.x();
+	const size_t height = (info.startOfFrameInfo.height * layout.vertical + data->maxHV.y() - 1) / data->maxHV.y();
+	const size_t blocksX = (width + 7) / 8;
+	const size_t blocksY = (height + 7) / 8;
+
+	for (size_t y = 0; y < blocksY; y++)
+	{
+		for (size_t x = 0; x < blocksX; x++)
+		{
+			restart(y * blocksX + x);
+
+			const size_t MCUIndex = FirstRowBlock(data, y / layout.vertical) + (x / layout.horizontal) * data->MCUBlockCount;
+			const size_t blockIndex = MCUIndex + layout.offset + (y % layout.vertical) * layout.horizontal + x % layout.horizontal;
+
+			DecodeProgressiveBlock(data, er, state, 0, blockIndex);
+		}
+	}
+}
+
+// Decodes the scans of a progressive image, scanLimit scans at most when it is not zero.
+static void DecodeProgressive(ImageData* data, const ImageInfo& info, const uint8_t* rawData, size_t size, size_t scanLimit)
+{
+	const size_t scanCount = (scanLimit ? std::min(scanLimit, info.scans.size()) : info.scans.size());
+
+	for (size_t i = 0; i < scanCount; i++)
+	{
+		DecodeProgressiveScan(data, info, info.scans[i], rawData, size);
+	}
+
+	// The end of every block is only known once all scans are in.
+	for (size_t i = 0; i < data->blocks.size(); i++)
+	{
+		size_t end = 0;
+		for (size_t k = 1; k < 64; k++)
+		{
+			if (data->blocks[i][zigzagTable[k]] != 0) end = k;
+		}
+		data->blockEnds[i] = C8(end);
+	}
+}
+
+void ImageLoader::LoadEntropyData() const
+{
+	if (config.streaming || info.type == ImageType::Ktx2) return;
+
+	std::call_once(decodeFlag, [this]()
+	{
+		if (info.type == ImageType::Png) DecodePngData();
+		else DecodeEntropyData();
+	});
+}
+
+void ImageLoader::DecodeEntropyData() const
+{
+	double start = Time::GetCurrentTime();
+
+	PrepareData();
+	AllocateBlocks(&data, data.MCUCount.y());
+
+	//double fileStart = Time::GetCurrentTime();
+
+	const uint8_t* rawData = file.GetData();
+
+	//std::cout << "File loaded in: " << (Time::GetCurrentTime() - fileStart) * 1000 << std::endl;
+
+	const size_t scanStart = info.startOfScanInfo.start + info.startOfScanInfo.length;
+
+	if (info.progressive)
+	{
+		DecodeProgressive(&data, info, rawData, file.GetSize(), config.progressiveScans);
+	}
+	else if (data.restartInterval)
+	{
+		// Restart intervals are independent, so they are decoded in parallel and every interval writes its own blocks.
+		std::vector<size_t> starts = FindRestartMarkers(rawData, file.GetSize(), scanStart);
+		starts.insert(starts.begin(), scanStart);
+
+		const size_t intervalCount = std::min(starts.size(), (data.MCUCount.z() + data.restartInterval - 1) / data.restartInterval);
+		const size_t taskLoad = (intervalCount + Scheduler::GetThreadCount() - 1) / Scheduler::GetThreadCount();
+
+		Scheduler::ParallelFor(intervalCount, taskLoad, [&](size_t first, size_t last)
+		{
+			DecodeRestartIntervals(&data, rawData, starts, file.GetSize(), first, last);
+		});
+	}
+	else
+	{
+		ByteReader br(rawData, file.GetSize());
+		br.Skip(scanStart);
+
+		std::vector<int> DCs(data.layouts.size());
+
+		EntropyReader er(br);
+
+		DecodeMCUs(&data, er, DCs, 0, data.MCUCount.z());
+	}
+
+	Scheduler::ParallelFor(data.blocks.size(), 4096, [this](size_t start, size_t end)
+	{
+		TransformBlocks(&data, start, end);
+	});
+	
+	//for (size_t i = 0; i < data.blocks.size(); i++)
+	//{
+	//	data.blocks[i] = FIDCTBlock(data.blocks[i]);
+	//}
+
+	//std::cout << "Tree search time: " << treeTime * 1000 << std::endl;
+
+	//std::cout << "Read time: " << readTime * 1000 << std::endl;
+
+	//std::cout << "Transform time: " << transformTime * 1000 << std::endl;
+
+	//std::cout << "Entropy loaded in: " << (Time::GetCurrentTime() - entropyStart) * 1000 << std::endl;
+
+	std::cout << info.name << " loaded in: " << (Time::GetCurrentTime() - start) * 1000 << " ms." << 
+		" With a total size of: " << (128 * data.blocks.size()) * 0.000001 << " mb." << std::endl;
+	//std::cout << data.blocks.size() << std::endl;
+	//std::cout << info << std::endl << std::endl;
+
+	//std::cout << "Fast found: " << fastFound << " Slow found: " << slowFound << std::endl;
+	//std::cout << "Add time: " << addTime * 1000 << " Sub time: " << subTime * 1000 << " Rest time: " << restTime * 1000 << std::endl;
+}
+
+void ImageLoader::TransformBlocks(ImageData* data, size_t start, size_t end)
+{
+	for (size_t i = start; i < end; i++)
+	{
+		const QuantizationTable& quantization = data->blockQuantization[i % data->blockQuantization.size()];
+
+		switch (data->blockSize)
+		{
+			case 1: IDCTBlockDC(data->blocks[i], quantization); break;
+			case 2: IDCTBlockReduced<2>(data->blocks[i], quantization); break;
+			case 4: IDCTBlockReduced<4>(data->blocks[i], quantization); break;
+			default: FIDCTBlock(data->blocks[i], quantization, data->blockEnds[i]); break;
+		}
+	}
+}
+
+// Fixed-point YCbCr to RGB factors in 16.16, split so that every factor fits in 16 bits.
+static const int colorScale = 16;
+static const int colorHalf = 1 << (colorScale - 1);
+static const int colorCrR = 26345;
+static const int colorCbG = -22554;
+static const int colorCrG = 18734;
+static const int colorCbB = -14942;
+
+static inline uint8_t ClampColor(int value)
+{
+	return (C8(std::clamp(value, 0, 255)));
+}
+
+// Converts a row of full resolution samples to RGBA, or RG when loading normal maps.
+static void ConvertColorRow(const uint8_t* Y, const uint8_t* Cb, const uint8_t* Cr, uint8_t* out, size_t width, size_t channels)
+{
+	size_t x = 0;
+
+#ifdef LOADER_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offset = _mm_set1_epi16(128);
+	const __m128i alpha = _mm_set1_epi8(-1);
+	const __m128i half = _mm_set1_epi32(colorHalf);
+	const __m128i factorR = _mm_setr_epi16(colorCrR, colorHalf / 2, colorCrR, colorHalf / 2, colorCrR, colorHalf / 2, colorCrR, colorHalf / 2);
+	const __m128i factorG = _mm_setr_epi16(colorCbG, colorCrG, colorCbG, colorCrG, colorCbG, colorCrG, colorCbG, colorCrG);
+	const __m128i factorB = _mm_setr_epi16(colorCbB, colorHalf / 2, colorCbB, colorHalf / 2, colorCbB, colorHalf / 2, colorCbB, colorHalf / 2);
+	const __m128i two = _mm_set1_epi16(2);
+
+	auto scale = [](__m128i low, __m128i high)
+	{
+		return (_mm_packs_epi32(_mm_srai_epi32(low, colorScale), _mm_srai_epi32(high, colorScale)));
+	};
+
+	for (; x + 8 <= width; x += 8)
+	{
+		const __m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Y + x)), zero);
+		const __m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Cb + x)), zero), offset);
+		const __m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Cr + x)), zero), offset);
+
+		// The rounding term is paired with a constant 2 since half of the scale does not fit in 16 bits.
+		const __m128i crTwo0 = _mm_unpacklo_epi16(cr, two);
+		const __m128i crTwo1 = _mm_unpackhi_epi16(cr, two);
+		const __m128i cbTwo0 = _mm_unpacklo_epi16(cb, two);
+		const __m128i cbTwo1 = _mm_unpackhi_epi16(cb, two);
+		const __m128i cbCr0 = _mm_unpacklo_epi16(cb, cr);
+		const __m128i cbCr1 = _mm_unpackhi_epi16(cb, cr);
+
+		__m128i r = scale(_mm_madd_epi16(crTwo0, factorR), _mm_madd_epi16(crTwo1, factorR));
+		__m128i g = scale(_mm_add_epi32(_mm_madd_epi16(cbCr0, factorG), half), _mm_add_epi32(_mm_madd_epi16(cbCr1, factorG), half));
+		__m128i b = scale(_mm_madd_epi16(cbTwo0, factorB), _mm_madd_epi16(cbTwo1, factorB));
+
+		r = _mm_add_epi16(_mm_add_epi16(r, cr), y);
+		g = _mm_add_epi16(_mm_sub_epi16(g, cr), y);
+		b = _mm_add_epi16(_mm_add_epi16(b, _mm_add_epi16(cb, cb)), y);
+
+		const __m128i r8 = _mm_packus_epi16(r, r);
+		const __m128i g8 = _mm_packus_epi16(g, g);
+		const __m128i rg = _mm_unpacklo_epi8(r8, g8);
+
+		if (channels == 2)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 2), rg);
+			continue;
+		}
+
+		const __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), alpha);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+	}
+#endif
+
+	for (; x < width; x++)
+	{
+		const int y = Y[x];
+		const int cb = Cb[x] - 128;
+		const int cr = Cr[x] - 128;
+
+		uint8_t* pixel = out + x * channels;
+		pixel[0] = ClampColor(y + cr + ((colorCrR * cr + colorHalf) >> colorScale));
+		pixel[1] = ClampColor(y - cr + ((colorCbG * cb + colorCrG * cr + colorHalf) >> colorScale));
+		if (channels == 2) continue;
+		pixel[2] = ClampColor(y + cb * 2 + ((colorCbB * cb + colorHalf) >> colorScale));
+		pixel[3] = 255;
+	}
+}
+
+// Copies one row of samples of a component out of its blocks, the row is padded to whole MCUs.
+static void ExtractComponentRow(const ImageData* data, size_t component, size_t row, uint8_t* out)
+{
+	const BlockLayout& layout = data->layouts[component];
+	const size_t size = data->blockSize;
+	const size_t MCURow = row / (layout.vertical * size);
+	const size_t blockRow = (row % (layout.vertical * size)) / size;
+	const size_t blockY = row % size;
+
+	size_t blockIndex = FirstRowBlock(data, MCURow) + layout.offset + blockRow * layout.horizontal;
+
+	for (size_t MCU = 0; MCU < data->MCUCount.x(); MCU++)
+	{
+		for (size_t i = 0; i < layout.horizontal; i++)
+		{
+			const int16_t* samples = &data->blocks[blockIndex + i][blockY * 8];
+
+#ifdef LOADER_SSE2
+			if (size == 8)
+			{
+				const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(values, values));
+				out += 8;
+				continue;
+			}
+#endif
+			for (size_t x = 0; x < size; x++) out[x] = C8(samples[x]);
+			out += size;
+		}
+
+		blockIndex += data->MCUBlockCount;
+	}
+}
+
+// Fancy horizontal upsampling, every output sample weighs its nearest input sample 3/4 and the next nearest 1/4.
+static void UpsampleRowH2V1(const uint8_t* in, uint8_t* out, size_t width)
+{
+	for (size_t x = 0; x < width; x++)
+	{
+		const int current = in[x] * 3;
+		out[x * 2] = C8((current + in[x > 0 ? x - 1 : 0] + 1) >> 2);
+		out[x * 2 + 1] = C8((current + in[x + 1 < width ? x + 1 : x] + 2) >> 2);
+	}
+}
+
+// Fancy upsampling in both directions, near and far are the two input rows closest to the output row.
+static void UpsampleRowH2V2(const uint8_t* near, const uint8_t* far, uint8_t* out, size_t width)
+{
+	int previous = near[0] * 3 + far[0];
+	int current = previous;
+
+	for (size_t x = 0; x < width; x++)
+	{
+		const int next = (x + 1 < width ? near[x + 1] * 3 + far[x + 1] : current);
+
+		out[x * 2] = C8((current * 3 + previous + 8) >> 4);
+		out[x * 2 + 1] = C8((current * 3 + next + 7) >> 4);
+
+		previous = current;
+		current = next;
+	}
+}
+
+// Fancy vertical upsampling, bias alternates between the upper and lower output row like the 2D filter.
+static void UpsampleRowH1V2(const uint8_t* near, const uint8_t* far, uint8_t* out, size_t width, int bias)
+{
+	for (size_t x = 0; x < width; x++) out[x] = C8((near[x] * 3 + far[x] + bias) >> 2);
+}
+
+// Replicates every input sample factor times, width is the output width.
+static void UpsampleRowNearest(const uint8_t* in, uint8_t* out, size_t width, size_t factor)
+{
+	if (factor == 1) return ((void)std::memcpy(out, in, width));
+
+	size_t x = 0;
+
+#ifdef LOADER_SSE2
+	if (factor == 2)
+	{
+		for (; x + 32 <= width; x += 32)
+		{
+			const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x / 2));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_unpacklo_epi8(samples, samples));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 16), _mm_unpackhi_epi8(samples, samples));
+		}
+	}
+#endif
+
+	for (; x < width; x += factor)
+	{
+		std::memset(out + x, in[x / factor], std::min(factor, width - x));
+	}
+}
+
+/** @brief Scratch rows used while converting one output row at a time. */
+struct ColorRows
+{
+	std::vector<uint8_t> luma;
+	std::array<std::vector<uint8_t>, 2> near;
+	std::array<std::vector<uint8_t>, 2> far;
+	std::array<std::vector<uint8_t>, 2> chroma;
+};
+
+// Produces the chroma samples of an output row at full resolution.
+static void UpsampleComponentRow(const ImageData* data, ColorRows& rows, size_t component, size_t row)
+{
+	const BlockLayout& layout = data->layouts[component];
+	const size_t factorH = data->maxHV.x() / layout.horizontal;
+	const size_t factorV = data->maxHV.y() / layout.vertical;
+	const size_t width = (data->dimensions.x() * layout.horizontal + data->maxHV.x() - 1) / data->maxHV.x();
+	const size_t height = (data->dimensions.y() * layout.vertical + data->maxHV.y() - 1) / data->maxHV.y();
+
+	std::vector<uint8_t>& near = rows.near[component - 1];
+	std::vector<uint8_t>& far = rows.far[component - 1];
+	std::vector<uint8_t>& out = rows.chroma[component - 1];
+
+	const size_t nearRow = row / factorV;
+	ExtractComponentRow(data, component, nearRow, near.data());
+
+	if (!data->fancyUpsampling || factorH > 2 || factorV > 2 || (factorH == 1 && factorV == 1))
+	{
+		UpsampleRowNearest(near.data(), out.data(), data->MCUCount.x() * data->HVC.x(), factorH);
+		return;
+	}
+
+	if (factorV == 1) return (UpsampleRowH2V1(near.data(), out.data(), width));
+
+	const bool upper = (row % 2 == 0);
+	const size_t farRow = (upper ? (nearRow > 0 ? nearRow - 1 : 0) : std::min(nearRow + 1, height - 1));
+	ExtractComponentRow(data, component, farRow, far.data());
+
+	if (factorH == 1) UpsampleRowH1V2(near.data(), far.data(), out.data(), width, (upper ? 1 : 2));
+	else UpsampleRowH2V2(near.data(), far.data(), out.data(), width);
+}
+
+static size_t PixelChannels(const ImageData* data)
+{
+	if (data->HVC.z() == 1) return (1);
+
+	return (data->normalMap ? 2 : 4);
+}
+
+// Converts output rows start to end into buffer, the rows only read blocks so ranges can be converted in parallel.
+static void LoadPixelRows(unsigned char* buffer, const ImageData* data, size_t start, size_t end)
+{
+	const size_t width = data->dimensions.x();
+	const size_t paddedWidth = data->MCUCount.x() * data->HVC.x();
+	const size_t channels = PixelChannels(data);
+
+	ColorRows rows{};
+	rows.luma.resize(paddedWidth);
+	for (size_t i = 0; i < 2; i++)
+	{
+		rows.near[i].resize(paddedWidth);
+		rows.far[i].resize(paddedWidth);
+		rows.chroma[i].resize(paddedWidth);
+	}
+
+	for (size_t y = start; y < end; y++)
+	{
+		unsigned char* out = buffer + (y - start) * width * channels;
+
+		if (data->layouts.size() == 1)
+		{
+			ExtractComponentRow(data, 0, y, rows.luma.data());
+			std::memcpy(out, rows.luma.data(), width);
+			continue;
+		}
+
+		ExtractComponentRow(data, 0, y, rows.luma.data());
+		UpsampleComponentRow(data, rows, 1, y);
+		UpsampleComponentRow(data, rows, 2, y);
+
+		ConvertColorRow(rows.luma.data(), rows.chroma[0].data(), rows.chroma[1].data(), out, width, channels);
+	}
+}
+
+// Reads sample index of a row stored at depth bits per sample.
+static uint16_t PngSample(const uint8_t* row, size_t index, size_t depth)
+{
+	if (depth == 8) return (row[index]);
+	if (depth == 16) return (C16((row[index * 2] << 8) | row[index * 2 + 1]));
+
+	const size_t bit = index * depth;
+	return (C16((row[bit / 8] >> (8 - depth - bit % 8)) & ((1 << depth) - 1)));
+}
+
+// Converts one unfiltered row to grey or RGBA depending on channels.
+static void LoadPngRow(unsigned char* out, const uint8_t* row, const PNGInfo& png, size_t channels)
+{
+	const size_t width = png.width;
+	const size_t depth = png.bitDepth;
+
+	// Samples below 8 bits are scaled to the full range, 16-bit samples keep their high byte.
+	const size_t scale = (depth < 8 ? 255 / ((CST(1) << depth) - 1) : 1);
+	const size_t shift = (depth == 16 ? 8 : 0);
+
+	if (depth == 8 && (png.colorType == 6 || (png.colorType == 0 && channels == 1)))
+	{
+		std::memcpy(out, row, width * channels);
+		return;
+	}
+
+	if (depth == 8 && png.colorType == 2 && !png.transparent)
+	{
+		for (size_t x = 0; x < width; x++)
+		{
+			out[x * 4] = row[x * 3];
+			out[x * 4 + 1] = row[x * 3 + 1];
+			out[x * 4 + 2] = row[x * 3 + 2];
+			out[x * 4 + 3] = 255;
+		}
+		return;
+	}
+
+	for (size_t x = 0; x < width; x++)
+	{
+		switch (png.colorType)
+		{
+			case 0:
+			{
+				const uint16_t sample = PngSample(row, x, depth);
+				const uint8_t grey = C8((sample >> shift) * scale);
+				if (channels == 1) { out[x] = grey; break; }
+				out[x * 4] = grey;
+				out[x * 4 + 1] = grey;
+				out[x * 4 + 2] = grey;
+				out[x * 4 + 3] = (sample == png.transparentColor[0] ? 0 : 255);
+				break;
+			}
+			case 2:
+			{
+				const uint16_t r = PngSample(row, x * 3, depth);
+				const uint16_t g = PngSample(row, x * 3 + 1, depth);
+				const uint16_t b = PngSample(row, x * 3 + 2, depth);
+				const bool clear = (png.transparent && r == png.transparentColor[0] && g == png.transparentColor[1] && b == png.transparentColor[2]);
+				out[x * 4] = C8(r >> shift);
+				out[x * 4 + 1] = C8(g >> shift);
+				out[x * 4 + 2] = C8(b >> shift);
+				out[x * 4 + 3] = (clear ? 0 : 255);
+				break;
+			}
+			case 3:
+			{
+				const size_t index = PngSample(row, x, depth);
+				if (index >= png.palette.size()) throw (std::runtime_error("PNG palette index out of range"));
+				std::memcpy(out + x * 4, png.palette[index].data(), 4);
+				break;
+			}
+			case 4:
+			{
+				const uint8_t grey = C8(PngSample(row, x * 2, depth) >> shift);
+				out[x * 4] = grey;
+				out[x * 4 + 1] = grey;
+				out[x * 4 + 2] = grey;
+				out[x * 4 + 3] = C8(PngSample(row, x * 2 + 1, depth) >> shift);
+				break;
+			}
+			case 6:
+			{
+				for (size_t c = 0; c < 4; c++) out[x * 4 + c] = C8(PngSample(row, x * 4 + c, depth) >> shift);
+				break;
+			}
+		}
+	}
+}
+
+static void LoadPngRows(unsigned char* buffer, const ImageInfo& info, const ImageData* data, size_t start, size_t end)
+{
+	const size_t width = info.pngInfo.width;
+	const size_t channels = PixelChannels(data);
+
+	// Normal maps keep only the first two channels of the RGBA row.
+	std::vector<unsigned char> expanded(channels != data->HVC.z() ? width * 4 : 0);
+
+	for (size_t y = start; y < end; y++)
+	{
+		const uint8_t* row = data->scanlines.data() + y * data->scanlineSize;
+		unsigned char* out = buffer + (y - start) * width * channels;
+
+		if (expanded.empty())
+		{
+			LoadPngRow(out, row, info.pngInfo, channels);
+			continue;
+		}
+
+		LoadPngRow(expanded.data(), row, info.pngInfo, data->HVC.z());
+		for (size_t x = 0; x < width; x++)
+		{
+			out[x * 2] = expanded[x * 4];
+			out[x * 2 + 1] = expanded[x * 4 + 1];
+		}
+	}
+}
+
+void ImageLoader::LoadPixels(std::vector<unsigned char>& buffer) const
+{
+	if (info.type == ImageType::Ktx2)
+	{
+		if (FormatBlockBytes(info.format)) throw (std::runtime_error("Block compressed textures have no pixels to load"));
+
+		buffer.assign(info.levels[0].pixels, info.levels[0].pixels + info.levels[0].size);
+		return;
+	}
+
+	LoadEntropyData();
+
+	const size_t rowSize = data.dimensions.x() * PixelChannels(&data);
+	buffer.resize(data.dimensions.y() * rowSize);
+
+	if (info.type == ImageType::Png) return (LoadPngRows(buffer.data(), info, &data, 0, data.dimensions.y()));
+
+	if (config.streaming)
+	{
+		StreamPixels([&buffer, rowSize](const unsigned char* pixels, size_t row, size_t rowCount)
+		{
+			std::memcpy(buffer.data() + row * rowSize, pixels, rowCount * rowSize);
+		});
+
+		return;
+	}
+
+	LoadPixelRows(buffer.data(), &data, 0, data.dimensions.y());
+}
+
+void ImageLoader::LoadPixelsThreaded(std::vector<unsigned char>& buffer) const
+{
+	if (config.streaming || info.type == ImageType::Ktx2) return (LoadPixels(buffer));
+
+	LoadEntropyData();
+
+	const size_t rowSize = data.dimensions.x() * PixelChannels(&data);
+	buffer.resize(data.dimensions.y() * rowSize);
+
+	if (info.type == ImageType::Png)
+	{
+		Scheduler::ParallelFor(data.dimensions.y(), 64, [&](size_t start, size_t end)
+		{
+			LoadPngRows(buffer.data() + start * rowSize, info, &data, start, end);
+		});
+
+		return;
+	}
+
+	// Bands are whole MCU rows so that no two tasks upsample from the same row of blocks.
+	const size_t threadCount = Scheduler::GetThreadCount();
+	const size_t threadLoad = std::max(CST(1), (data.MCUCount.y() + threadCount - 1) / threadCount) * data.HVC.y();
+
+	Scheduler::ParallelFor(data.dimensions.y(), threadLoad, [&](size_t start, size_t end)
+	{
+		LoadPixelRows(buffer.data() + start * rowSize, &data, start, end);
+	});
+}
+
+void ImageLoader::StreamPixels(const PixelRowCallback& callback) const
+{
+	// Fancy upsampling reads the chroma rows above and below, so a row is converted once the next one is decoded.
+	ImageData stream = data;
+	AllocateBlocks(&stream, 3);
+
+	const uint8_t* rawData = file.GetData();
+
+	ByteReader br(rawData, file.GetSize());
+	br.Skip(info.startOfScanInfo.start + info.startOfScanInfo.length);
+
+	std::vector<int> DCs(stream.layouts.size());
+
+	EntropyReader er(br);
+
+	const size_t rowHeight = stream.HVC.y();
+	const size_t rowBlocks = stream.MCUCount.x() * stream.MCUBlockCount;
+	std::vector<unsigned char> pixels(rowHeight * stream.dimensions.x() * PixelChannels(&stream));
+
+	for (size_t MCURow = 0; MCURow <= stream.MCUCount.y(); MCURow++)
+	{
+		if (MCURow < stream.MCUCount.y())
+		{
+			DecodeMCUs(&stream, er, DCs, MCURow * stream.MCUCount.x(), stream.MCUCount.x());
+
+			const size_t firstBlock = FirstRowBlock(&stream, MCURow);
+			TransformBlocks(&stream, firstBlock, firstBlock + rowBlocks);
+		}
+
+		if (MCURow == 0) continue;
+
+		const size_t start = (MCURow - 1) * rowHeight;
+		const size_t end = std::min(start + rowHeight, stream.dimensions.y());
+
+		LoadPixelRows(pixels.data(), &stream, start, end);
+		callback(pixels.data(), start, end - start);
+	}
+}
+
+const ImageLoaderConfig& ImageLoader::GetConfig() const
+{
+	return (config);
+}
+
+size_t ImageLoader::GetChannels() const
+{
+	return (PixelChannels(&data));
+}
+
+size_t ImageLoader::GetWidth() const
+{
+	return (data.dimensions.x());
+}
+
+size_t ImageLoader::GetHeight() const
+{
+	return (data.dimensions.y());
+}
+
+const FileView& ImageLoader::GetFile() const
+{
+	return (file);
+}
+
+VkFormat ImageLoader::GetFormat() const
+{
+	return (info.format);
+}
+
+const std::vector<MipLevelView>& ImageLoader::GetLevels() const
+{
+	return (info.levels);
+}
+
+uint8_t LoadChannelClamped(const unsigned char* pixels, Point<int, 2> xy, Point<int, 3> whs, int channel)
+{
+	int x = std::min(whs.x() - 1, std::max(0, xy.x()));
+	int y = std::min(whs.y() - 1, std::max(0, xy.y()));
+
+	return (pixels[y * whs.z() + x * 4 + channel]);
+}
+
+// Block compressors work on four blocks at once, each lane of a Lanes value belongs to one block.
+#ifdef LOADER_SSE2
+struct Lanes
+{
+	__m128 v;
+
+	Lanes() : v(_mm_setzero_ps()) {}
+	Lanes(float value) : v(_mm_set1_ps(value)) {}
+	Lanes(__m128 value) : v(value) {}
+};
+
+static inline Lanes operator+(Lanes a, Lanes b) { return (_mm_add_ps(a.v, b.v)); }
+static inline Lanes operator-(Lanes a, Lanes b) { return (_mm_sub_ps(a.v, b.v)); }
+static inline Lanes operator*(Lanes a, Lanes b) { return (_mm_mul_ps(a.v, b.v)); }
+static inline Lanes operator/(Lanes a, Lanes b) { return (_mm_div_ps(a.v, b.v)); }
+static inline Lanes Min(Lanes a, Lanes b) { return (_mm_min_ps(a.v, b.v)); }
+static inline Lanes Max(Lanes a, Lanes b) { return (_mm_max_ps(a.v, b.v)); }
+static inline Lanes Less(Lanes a, Lanes b) { return (_mm_cmplt_ps(a.v, b.v)); }
+static inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return (_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))); }
+static inline Lanes Truncate(Lanes a) { return (_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v))); }
+static inline void Store(Lanes a, float* values) { _mm_storeu_ps(values, a.v); }
+#else
+struct Lanes
+{
+	std::array<float, 4> v{};
+
+	Lanes() {}
+	Lanes(float value) { v.fill(value); }
+};
+
+template <typename F> static inline Lanes LaneWise(Lanes a, Lanes b, F function)
+{
+	Lanes result;
+	for (size_t i = 0; i < 4; i++) result.v[i] = function(a.v[i], b.v[i]);
+	return (result);
+}
+
+static inline Lanes operator+(Lanes a, Lanes b) { return (LaneWise(a, b, [](float x, float y) { return (x + y); })); }
+static inline Lanes operator-(Lanes a, Lanes b) { return (LaneWise(a, b, [](float x, float y) { return (x - y); })); }
+static inline Lanes operator*(Lanes a, Lanes b) { return (LaneWise(a, b, [](float x, float y) { return (x * y); })); }
+static inline Lanes operator/(Lanes a, Lanes b) { return (LaneWise(a, b, [](float x, float y) { return (x / y); })); }
+static inline Lanes Min(Lanes a, Lanes b) { return (LaneWise(a, b, [](float x, float y) { return (std::min(x, y)); })); }
+static inline Lanes Max(Lanes a, Lanes b) { return (LaneWise(a, b, [](float x, float y) { return (std::max(x, y)); })); }
+static inline Lanes Less(Lanes a, Lanes b) { return (LaneWise(a, b, [](float x, float y) { return (x < y ? 1.0f : 0.0f); })); }
+static inline Lanes Truncate(Lanes a) { return (LaneWise(a, a, [](float x, float) { return (std::trunc(x)); })); }
+static inline void Store(Lanes a, float* values) { std::memcpy(values, a.v.data(), sizeof(float) * 4); }
+
+static inline Lanes Select(Lanes mask, Lanes a, Lanes b)
+{
+	Lanes result;
+	for (size_t i = 0; i < 4; i++) result.v[i] = (mask.v[i] != 0.0f ? a.v[i] : b.v[i]);
+	return (result);
+}
+#endif
+
+static inline Lanes Clamp(Lanes a, float low, float high)
+{
+	return (Min(Max(a, low), high));
+}
+
+/** @brief Channels of the 16 pixels of four neighbouring blocks. */
+struct BlockGroup
+{
+	std::array<std::array<Lanes, 16>, 4> channels;
+};
+
+/** @brief BC1 endpoint of four blocks, as 5:6:5 values and the color they expand to. */
+struct BC1Endpoint
+{
+	std::array<Lanes, 3> quantized;
+	std::array<Lanes, 3> color;
+};
+
+// Reads the four blocks starting at pixel xy, pixels outside the image repeat the nearest edge pixel.
+static void GatherBlocks(const unsigned char* pixels, Point<int, 2> xy, Point<int, 3> whs, BlockGroup& group)
+{
+	std::array<uint8_t, 16 * 4 * 4> edge;
+	const unsigned char* rows = pixels + CST(xy.y()) * whs.z() + CST(xy.x()) * 4;
+	size_t stride = whs.z();
+
+	if (xy.x() + 16 > whs.x() || xy.y() + 4 > whs.y())
+	{
+		for (int dy = 0; dy < 4; dy++)
+		{
+			const int y = std::min(whs.y() - 1, xy.y() + dy);
+
+			for (int dx = 0; dx < 16; dx++)
+			{
+				const int x = std::min(whs.x() - 1, xy.x() + dx);
+				std::memcpy(edge.data() + (dy * 16 + dx) * 4, pixels + CST(y) * whs.z() + CST(x) * 4, 4);
+			}
+		}
+
+		rows = edge.data();
+		stride = 16 * 4;
+	}
+
+	for (size_t dy = 0; dy < 4; dy++)
+	{
+		const unsigned char* row = rows + dy * stride;
+
+#ifdef LOADER_SSE2
+		// After the transpose register dx holds pixel dx of the current row of every block.
+		__m128 pixel[4];
+		for (size_t block = 0; block < 4; block++) pixel[block] = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + block * 16)));
+		_MM_TRANSPOSE4_PS(pixel[0], pixel[1], pixel[2], pixel[3]);
+
+		const __m128i mask = _mm_set1_epi32(0xFF);
+
+		for (size_t dx = 0; dx < 4; dx++)
+		{
+			const __m128i packed = _mm_castps_si128(pixel[dx]);
+
+			for (size_t c = 0; c < 4; c++)
+			{
+				group.channels[c][dy * 4 + dx] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 8 * c), mask));
+			}
+		}
+#else
+		for (size_t dx = 0; dx < 4; dx++)
+		{
+			for (size_t block = 0; block < 4; block++)
+			{
+				for (size_t c = 0; c < 4; c++) group.channels[c][dy * 4 + dx].v[block] = row[block * 16 + dx * 4 + c];
+			}
+		}
+#endif
+	}
+}
+
+// Rounds colors to 5:6:5 and expands them back the way the GPU does, by repeating the top bits.
+static BC1Endpoint QuantizeBC1(const std::array<Lanes, 3>& color)
+{
+	static const std::array<float, 3> maxima = {31.0f, 63.0f, 31.0f};
+
+	BC1Endpoint endpoint;
+
+	for (size_t c = 0; c < 3; c++)
+	{
+		const float levels = maxima[c] + 1.0f;
+		const float scale = 256.0f / levels;
+		const Lanes quantized = Truncate(Clamp(color[c], 0.0f, 255.0f) * (maxima[c] / 255.0f) + 0.5f);
+
+		endpoint.quantized[c] = quantized;
+		endpoint.color[c] = quantized * scale + Truncate(quantized * (scale / levels));
+	}
+
+	return (endpoint);
+}
+
+// Perceptual weights of the color error, green matters most and blue least.
+static const std::array<float, 3> bc1Weights = {3.0f, 6.0f, 1.0f};
+
+// BC1 index of each step along the line from the second endpoint to the first.
+static const std::array<uint32_t, 4> bc1StepIndices = {1, 3, 2, 0};
+
+// Chooses the step of every pixel from the second endpoint (0) to the first (3) and returns the weighted squared error of each block.
+static Lanes SelectBC1Steps(const BlockGroup& group, const BC1Endpoint& first, const BC1Endpoint& second, CompressionMode mode, std::array<Lanes, 16>& steps)
+{
+	std::array<std::array<Lanes, 3>, 4> palette;
+
+	for (size_t c = 0; c < 3; c++)
+	{
+		palette[0][c] = second.color[c];
+		palette[1][c] = (first.color[c] + second.color[c] * 2.0f) * (1.0f / 3.0f);
+		palette[2][c] = (first.color[c] * 2.0f + second.color[c]) * (1.0f / 3.0f);
+		palette[3][c] = first.color[c];
+	}
+
+	Lanes totalError = 0.0f;
+
+	if (mode == CompressionMode::Fast)
+	{
+		// Pixels are projected onto the line between the endpoints and rounded to the nearest of its four points.
+		std::array<Lanes, 3> direction;
+		for (size_t c = 0; c < 3; c++) direction[c] = palette[3][c] - palette[0][c];
+
+		const Lanes length = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+		const Lanes scale = Lanes(3.0f) / Max(length, 1e-6f);
+
+		for (size_t i = 0; i < 16; i++)
+		{
+			Lanes projection = 0.0f;
+			for (size_t c = 0; c < 3; c++) projection = projection + (group.channels[c][i] - palette[0][c]) * direction[c];
+
+			steps[i] = Truncate(Clamp(projection * scale, 0.0f, 3.0f) + 0.5f);
+		}
+
+		// Fast mode never compares errors, so they are not computed.
+		return (totalError);
+	}
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		Lanes bestError = 0.0f;
+		Lanes bestStep = 0.0f;
+
+		for (size_t entry = 0; entry < 4; entry++)
+		{
+			Lanes error = 0.0f;
+			for (size_t c = 0; c < 3; c++)
+			{
+				const Lanes difference = group.channels[c][i] - palette[entry][c];
+				error = error + difference * difference * bc1Weights[c];
+			}
+
+			if (entry == 0)
+			{
+				bestError = error;
+				continue;
+			}
+
+			const Lanes better = Less(error, bestError);
+			bestError = Select(better, error, bestError);
+			bestStep = Select(better, Lanes(float(entry)), bestStep);
+		}
+
+		steps[i] = bestStep;
+		totalError = totalError + bestError;
+	}
+
+	return (totalError);
+}
+
+// Least squares fit of the two endpoints that best reproduce the pixels, weights holds the share of the first endpoint in every pixel.
+template <size_t C> static void RefineEndpoints(const BlockGroup& group, const std::array<Lanes, 16>& weights, std::array<Lanes, C>& first, std::array<Lanes, C>& second)
+{
+	Lanes aa = 0.0f;
+	Lanes bb = 0.0f;
+	Lanes ab = 0.0f;
+	std::array<Lanes, C> ax;
+	std::array<Lanes, C> bx;
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		const Lanes alpha = weights[i];
+		const Lanes beta = Lanes(1.0f) - alpha;
+
+		aa = aa + alpha * alpha;
+		bb = bb + beta * beta;
+		ab = ab + alpha * beta;
+
+		for (size_t c = 0; c < C; c++)
+		{
+			ax[c] = ax[c] + alpha * group.channels[c][i];
+			bx[c] = bx[c] + beta * group.channels[c][i];
+		}
+	}
+
+	// Blocks whose pixels all share one weight have no unique solution and keep their endpoints.
+	const Lanes determinant = aa * bb - ab * ab;
+	const Lanes solvable = Less(1e-4f, determinant);
+	const Lanes inverse = Lanes(1.0f) / Select(solvable, determinant, 1.0f);
+
+	for (size_t c = 0; c < C; c++)
+	{
+		first[c] = Select(solvable, Clamp((ax[c] * bb - bx[c] * ab) * inverse, 0.0f, 255.0f), first[c]);
+		second[c] = Select(solvable, Clamp((bx[c] * aa - ax[c] * ab) * inverse, 0.0f, 255.0f), second[c]);
+	}
+}
+
+// Places the endpoints of the first C channels at the ends of the pixels along their principal axis, first at the high end.
+template <size_t C> static void FitPrincipalAxis(const BlockGroup& group, std::array<Lanes, C>& first, std::array<Lanes, C>& second)
+{
+	std::array<Lanes, C> mean;
+	std::array<Lanes, C> minimum;
+	std::array<Lanes, C> maximum;
+
+	for (size_t c = 0; c < C; c++)
+	{
+		minimum[c] = group.channels[c][0];
+		maximum[c] = group.channels[c][0];
+
+		for (size_t i = 0; i < 16; i++)
+		{
+			mean[c] = mean[c] + group.channels[c][i];
+			minimum[c] = Min(minimum[c], group.channels[c][i]);
+			maximum[c] = Max(maximum[c], group.channels[c][i]);
+		}
+
+		mean[c] = mean[c] * (1.0f / 16.0f);
+	}
+
+	std::array<std::array<Lanes, C>, C> covariance;
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		std::array<Lanes, C> offset;
+		for (size_t c = 0; c < C; c++) offset[c] = group.channels[c][i] - mean[c];
+
+		for (size_t row = 0; row < C; row++)
+		{
+			for (size_t column = row; column < C; column++) covariance[row][column] = covariance[row][column] + offset[row] * offset[column];
+		}
+	}
+
+	for (size_t row = 1; row < C; row++)
+	{
+		for (size_t column = 0; column < row; column++) covariance[row][column] = covariance[column][row];
+	}
+
+	// Power iteration from the bounding box diagonal converges on the principal axis in a few steps.
+	std::array<Lanes, C> axis;
+	for (size_t c = 0; c < C; c++) axis[c] = maximum[c] - minimum[c];
+
+	for (size_t iteration = 0; iteration < 4; iteration++)
+	{
+		std::array<Lanes, C> next;
+		Lanes largest = 0.0f;
+
+		for (size_t row = 0; row < C; row++)
+		{
+			for (size_t column = 0; column < C; column++) next[row] = next[row] + covariance[row][column] * axis[column];
+			largest = Max(largest, Max(next[row], Lanes(0.0f) - next[row]));
+		}
+
+		const Lanes inverse = Lanes(1.0f) / Max(largest, 1e-6f);
+		for (size_t c = 0; c < C; c++) axis[c] = next[c] * inverse;
+	}
+
+	Lanes low = 0.0f;
+	Lanes high = 0.0f;
+	Lanes length = 0.0f;
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		Lanes projection = 0.0f;
+		for (size_t c = 0; c < C; c++) projection = projection + (group.channels[c][i] - mean[c]) * axis[c];
+
+		low = Min(low, projection);
+		high = Max(high, projection);
+	}
+
+	for (size_t c = 0; c < C; c++) length = length + axis[c] * axis[c];
+	const Lanes inverseLength = Lanes(1.0f) / Max(length, 1e-6f);
+
+	for (size_t c = 0; c < C; c++)
+	{
+		first[c] = mean[c] + axis[c] * high * inverseLength;
+		second[c] = mean[c] + axis[c] * low * inverseLength;
+	}
+}
+
+// Compresses blockCount of the four blocks in group to BC1, stride bytes apart in output.
+static void CompressBlocksBC1(unsigned char* output, size_t stride, const BlockGroup& group, size_t blockCount, CompressionMode mode)
+{
+	std::array<Lanes, 3> first;
+	std::array<Lanes, 3> second;
+	FitPrincipalAxis(group, first, second);
+
+	BC1Endpoint firstEndpoint = QuantizeBC1(first);
+	BC1Endpoint secondEndpoint = QuantizeBC1(second);
+
+	std::array<Lanes, 16> steps;
+	Lanes error = SelectBC1Steps(group, firstEndpoint, secondEndpoint, mode, steps);
+
+	// Quality mode refits the endpoints to the chosen steps and keeps the result where it lowers the error.
+	const size_t refinements = (mode == CompressionMode::Quality ? 2 : 0);
+
+	for (size_t refinement = 0; refinement < refinements; refinement++)
+	{
+		std::array<Lanes, 16> weights;
+		for (size_t i = 0; i < 16; i++) weights[i] = steps[i] * (1.0f / 3.0f);
+
+		RefineEndpoints(group, weights, first, second);
+
+		const BC1Endpoint refinedFirst = QuantizeBC1(first);
+		const BC1Endpoint refinedSecond = QuantizeBC1(second);
+
+		std::array<Lanes, 16> refinedSteps;
+		const Lanes refinedError = SelectBC1Steps(group, refinedFirst, refinedSecond, mode, refinedSteps);
+		const Lanes better = Less(refinedError, error);
+
+		for (size_t c = 0; c < 3; c++)
+		{
+			firstEndpoint.quantized[c] = Select(better, refinedFirst.quantized[c], firstEndpoint.quantized[c]);
+			secondEndpoint.quantized[c] = Select(better, refinedSecond.quantized[c], secondEndpoint.quantized[c]);
+		}
+
+		for (size_t i = 0; i < 16; i++) steps[i] = Select(better, refinedSteps[i], steps[i]);
+		error = Select(better, refinedError, error);
+	}
+
+	std::array<std::array<float, 4>, 3> firstValues;
+	std::array<std::array<float, 4>, 3> secondValues;
+	std::array<std::array<float, 4>, 16> stepValues;
+
+	for (size_t c = 0; c < 3; c++)
+	{
+		Store(firstEndpoint.quantized[c], firstValues[c].data());
+		Store(secondEndpoint.quantized[c], secondValues[c].data());
+	}
+
+	for (size_t i = 0; i < 16; i++) Store(steps[i], stepValues[i].data());
+
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		uint16_t color0 = C16((C16(firstValues[0][block]) << 11) | (C16(firstValues[1][block]) << 5) | C16(firstValues[2][block]));
+		uint16_t color1 = C16((C16(secondValues[0][block]) << 11) | (C16(secondValues[1][block]) << 5) | C16(secondValues[2][block]));
+
+		uint32_t indexBits = 0;
+		for (size_t i = 0; i < 16; i++) indexBits |= bc1StepIndices[CST(stepValues[i][block])] << (2 * i);
+
+		// The four color mode needs color0 > color1, swapping the endpoints swaps indices 0 with 1 and 2 with 3.
+		if (color0 < color1)
+		{
+			std::swap(color0, color1);
+			indexBits ^= 0x55555555u;
+		}
+		else if (color0 == color1)
+		{
+			indexBits = 0;
+		}
+
+		unsigned char* buffer = output + block * stride;
+		buffer[0] = C8(color0 & 0xFF);
+		buffer[1] = C8(color0 >> 8);
+		buffer[2] = C8(color1 & 0xFF);
+		buffer[3] = C8(color1 >> 8);
+		std::memcpy(buffer + 4, &indexBits, 4);
+	}
+}
+
+// Interpolation weights of the 4-bit BC7 indices, out of 64.
+static const std::array<float, 16> bc7Weights = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/** @brief BC7 mode 6 endpoint of four blocks, as 7-bit values with a shared low bit and the color they expand to. */
+struct BC7Endpoint
+{
+	std::array<Lanes, 4> quantized;
+	Lanes parity;
+	std::array<Lanes, 4> color;
+};
+
+// Rounds an RGBA endpoint to 7 bits per channel and picks the shared low bit that lands closer.
+static BC7Endpoint QuantizeBC7(const std::array<Lanes, 4>& color)
+{
+	std::array<BC7Endpoint, 2> candidates;
+	std::array<Lanes, 2> errors;
+
+	for (size_t parity = 0; parity < 2; parity++)
+	{
+		BC7Endpoint& candidate = candidates[parity];
+		candidate.parity = float(parity);
+
+		for (size_t c = 0; c < 4; c++)
+		{
+			const Lanes value = Clamp(color[c], 0.0f, 255.0f);
+
+			candidate.quantized[c] = Min(Truncate((value - float(parity)) * 0.5f + 0.5f), 127.0f);
+			candidate.color[c] = candidate.quantized[c] * 2.0f + float(parity);
+
+			const Lanes difference = candidate.color[c] - value;
+			errors[parity] = errors[parity] + difference * difference;
+		}
+	}
+
+	const Lanes odd = Less(errors[1], errors[0]);
+
+	BC7Endpoint endpoint;
+	endpoint.parity = Select(odd, candidates[1].parity, candidates[0].parity);
+
+	for (size_t c = 0; c < 4; c++)
+	{
+		endpoint.quantized[c] = Select(odd, candidates[1].quantized[c], candidates[0].quantized[c]);
+		endpoint.color[c] = Select(odd, candidates[1].color[c], candidates[0].color[c]);
+	}
+
+	return (endpoint);
+}
+
+// Chooses the index of every pixel from the second endpoint (0) to the first (15), returns the squared error of each block.
+static Lanes SelectBC7Indices(const BlockGroup& group, const BC7Endpoint& first, const BC7Endpoint& second, CompressionMode mode, std::array<Lanes, 16>& indices, std::array<Lanes, 16>& weights)
+{
+	Lanes totalError = 0.0f;
+
+	if (mode == CompressionMode::Fast)
+	{
+		// The weights are close to even steps, so the projection onto the endpoint line is rounded to sixteenths.
+		std::array<Lanes, 4> direction;
+		for (size_t c = 0; c < 4; c++) direction[c] = first.color[c] - second.color[c];
+
+		const Lanes length = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2] + direction[3] * direction[3];
+		const Lanes scale = Lanes(15.0f) / Max(length, 1e-6f);
+
+		for (size_t i = 0; i < 16; i++)
+		{
+			Lanes projection = 0.0f;
+			for (size_t c = 0; c < 4; c++) projection = projection + (group.channels[c][i] - second.color[c]) * direction[c];
+
+			indices[i] = Truncate(Clamp(projection * scale, 0.0f, 15.0f) + 0.5f);
+			weights[i] = indices[i] * (1.0f / 15.0f);
+		}
+
+		return (totalError);
+	}
+
+	std::array<std::array<Lanes, 4>, 16> palette;
+
+	for (size_t entry = 0; entry < 16; entry++)
+	{
+		const float weight = bc7Weights[entry];
+
+		for (size_t c = 0; c < 4; c++)
+		{
+			palette[entry][c] = Truncate((second.color[c] * (64.0f - weight) + first.color[c] * weight + 32.0f) * (1.0f / 64.0f));
+		}
+	}
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		Lanes bestError = 0.0f;
+		Lanes bestIndex = 0.0f;
+
+		for (size_t entry = 0; entry < 16; entry++)
+		{
+			Lanes error = 0.0f;
+			for (size_t c = 0; c < 4; c++)
+			{
+				const Lanes difference = group.channels[c][i] - palette[entry][c];
+				error = error + difference * difference;
+			}
+
+			if (entry == 0)
+			{
+				bestError = error;
+				continue;
+			}
+
+			const Lanes better = Less(error, bestError);
+			bestError = Select(better, error, bestError);
+			bestIndex = Select(better, Lanes(float(entry)), bestIndex);
+		}
+
+		indices[i] = bestIndex;
+		totalError = totalError + bestError;
+	}
+
+	// The exact weights are only needed to refine, which only runs in quality mode.
+	for (size_t i = 0; i < 16; i++)
+	{
+		Lanes weight = 0.0f;
+		for (size_t entry = 1; entry < 16; entry++) weight = Select(Less(float(entry) - 0.5f, indices[i]), Lanes(bc7Weights[entry] / 64.0f), weight);
+		weights[i] = weight;
+	}
+
+	return (totalError);
+}
+
+// Compresses blockCount of the four blocks in group to BC7 mode 6, one RGBA subset with 7.7.7.7 endpoints, shared low bits and 4-bit indices.
+static void CompressBlocksBC7(unsigned char* output, const BlockGroup& group, size_t blockCount, CompressionMode mode)
+{
+	std::array<Lanes, 4> first;
+	std::array<Lanes, 4> second;
+	FitPrincipalAxis(group, first, second);
+
+	BC7Endpoint firstEndpoint = QuantizeBC7(first);
+	BC7Endpoint secondEndpoint = QuantizeBC7(second);
+
+	std::array<Lanes, 16> indices;
+	std::array<Lanes, 16> weights;
+	Lanes error = SelectBC7Indices(group, firstEndpoint, secondEndpoint, mode, indices, weights);
+
+	const size_t refinements = (mode == CompressionMode::Quality ? 2 : 0);
+
+	for (size_t refinement = 0; refinement < refinements; refinement++)
+	{
+		RefineEndpoints(group, weights, first, second);
+
+		const BC7Endpoint refinedFirst = QuantizeBC7(first);
+		const BC7Endpoint refinedSecond = QuantizeBC7(second);
+
+		std::array<Lanes, 16> refinedIndices;
+		std::array<Lanes, 16> refinedWeights;
+		const Lanes refinedError = SelectBC7Indices(group, refinedFirst, refinedSecond, mode, refinedIndices, refinedWeights);
+		const Lanes better = Less(refinedError, error);
+
+		for (size_t c = 0; c < 4; c++)
+		{
+			firstEndpoint.quantized[c] = Select(better, refinedFirst.quantized[c], firstEndpoint.quantized[c]);
+			secondEndpoint.quantized[c] = Select(better, refinedSecond.quantized[c], secondEndpoint.quantized[c]);
+		}
+
+		firstEndpoint.parity = Select(better, refinedFirst.parity, firstEndpoint.parity);
+		secondEndpoint.parity = Select(better, refinedSecond.parity, secondEndpoint.parity);
+
+		for (size_t i = 0; i < 16; i++)
+		{
+			indices[i] = Select(better, refinedIndices[i], indices[i]);
+			weights[i] = Select(better, refinedWeights[i], weights[i]);
+		}
+
+		error = Select(better, refinedError, error);
+	}
+
+	// Endpoint 0 is the second endpoint, the one with weight 0.
+	std::array<std::array<std::array<float, 4>, 4>, 2> endpointValues;
+	std::array<std::array<float, 4>, 2> parityValues;
+	std::array<std::array<float, 4>, 16> indexValues;
+
+	for (size_t c = 0; c < 4; c++)
+	{
+		Store(secondEndpoint.quantized[c], endpointValues[0][c].data());
+		Store(firstEndpoint.quantized[c], endpointValues[1][c].data());
+	}
+
+	Store(secondEndpoint.parity, parityValues[0].data());
+	Store(firstEndpoint.parity, parityValues[1].data());
+	for (size_t i = 0; i < 16; i++) Store(indices[i], indexValues[i].data());
+
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		// The top bit of the first pixel's index is implied to be 0, otherwise the endpoints swap and the indices mirror.
+		const bool swap = (indexValues[0][block] >= 8.0f);
+		const size_t low = (swap ? 1 : 0);
+
+		std::array<uint64_t, 2> bits{};
+		size_t position = 0;
+
+		auto write = [&bits, &position](uint64_t value, size_t count)
+		{
+			for (size_t i = 0; i < count; i++, position++) bits[position / 64] |= ((value >> i) & 1) << (position % 64);
+		};
+
+		write(1 << 6, 7);
+
+		for (size_t c = 0; c < 4; c++)
+		{
+			write(uint64_t(endpointValues[low][c][block]), 7);
+			write(uint64_t(endpointValues[1 - low][c][block]), 7);
+		}
+
+		write(uint64_t(parityValues[low][block]), 1);
+		write(uint64_t(parityValues[1 - low][block]), 1);
+
+		for (size_t i = 0; i < 16; i++)
+		{
+			const uint64_t index = uint64_t(indexValues[i][block]);
+			write(swap ? 15 - index : index, (i == 0 ? 3 : 4));
+		}
+
+		if constexpr (std::endian::native == std::endian::big)
+		{
+			bits[0] = std::byteswap(bits[0]);
+			bits[1] = std::byteswap(bits[1]);
+		}
+
+		std::memcpy(output + block * 16, bits.data(), 16);
+	}
+}
+
+std::array<uint8_t, 8> BuildBC4Palette(uint8_t a0, uint8_t a1)
+{
+	std::array<uint8_t, 8> palette{};
+	palette[0] = a0;
+	palette[1] = a1;
+
+	if (a0 > a1)
+	{
+		palette[2] = (uint8_t)((6 * int(a0) + 1 * int(a1) + 3) / 7);
+		palette[3] = (uint8_t)((5 * int(a0) + 2 * int(a1) + 3) / 7);
+		palette[4] = (uint8_t)((4 * int(a0) + 3 * int(a1) + 3) / 7);
+		palette[5] = (uint8_t)((3 * int(a0) + 4 * int(a1) + 3) / 7);
+		palette[6] = (uint8_t)((2 * int(a0) + 5 * int(a1) + 3) / 7);
+		palette[7] = (uint8_t)((1 * int(a0) + 6 * int(a1) + 3) / 7);
+	}
+	else
+	{
+		palette[2] = (uint8_t)((4 * int(a0) + 1 * int(a1) + 2) / 5);
+		palette[3] = (uint8_t)((3 * int(a0) + 2 * int(a1) + 2) / 5);
+		palette[4] = (uint8_t)((2 * int(a0) + 3 * int(a1) + 2) / 5);
+		palette[5] = (uint8_t)((1 * int(a0) + 4 * int(a1) + 2) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	return (palette);
+}
+
+void LoadCompressedBlockBC4(unsigned char* buffer, const unsigned char* pixels, Point<int, 2> xy, Point<int, 3> whs, int channel)
+{
+	uint8_t block[16];
+	int idx = 0;
+	uint8_t vMin=255, vMax=0;
+
+	for (int dy = 0; dy < 4; dy++)
+	{
+		for (int dx = 0; dx < 4; dx++, idx++)
+		{
+			Point<int, 2> dxy(dx, dy);
+			uint8_t c = LoadChannelClamped(pixels, xy + dxy, whs, channel);
+			block[idx] = c;
+
+			vMin = std::min(vMin, c);
+        	vMax = std::max(vMax, c);
+		}
+	}
+
+	if (vMin == vMax)
+	{
+		uint8_t a0 = vMax;
+		uint8_t a1 = (uint8_t)std::max(0, vMax - 1);
+		std::array<uint8_t, 8> palette = BuildBC4Palette(a0, a1);
+
+		uint64_t bits = 0;
+		buffer[0] = a0;
+		buffer[1] = a1;
+		std::memcpy(buffer + 2, &bits, 6);
+
+		return;
+	}
+
+	uint8_t initial_a0 = vMax;
+	uint8_t initial_a1 = vMin;
+
+	uint8_t best_a0 = 0, best_a1 = 0;
+	uint64_t bestBits = 0;
+	uint32_t bestError = 0xFFFFFFFFu;
+
+	for (int order = 0; order < 2; order++)
+	{
+		uint8_t a0 = initial_a0, a1 = initial_a1;
+		if (order == 1) {std::swap(a0, a1);}
+
+		std::array<uint8_t, 8> palette = BuildBC4Palette(a0, a1);
+		uint64_t bits = 0;
+		uint32_t error = 0;
+
+		for (int i = 0; i < 16; i++)
+		{
+			uint8_t v = block[i];
+			int bestJ = 0;
+
+			int d = int(v) - int(palette[0]);
+			int bestd2 = d * d;
+
+			for (int j = 1; j < 8; j++)
+			{
+				int dd = int(v) - int(palette[j]);
+				int d2 = dd * dd;
+				if (d2 < bestd2) {bestd2 = d2; bestJ = j;}
+			}
+
+			error += (uint32_t)bestd2;
+			bits |= (uint64_t)(bestJ & 7) << (3 * i);
+		}
+
+		if (error < bestError)
+		{
+			bestError = error;
+			best_a0 = a0;
+			best_a1 = a1;
+			bestBits = bits;
+		}
+	}
+
+	buffer[0] = best_a0;
+	buffer[1] = best_a1;
+	std::memcpy(buffer + 2, &bestBits, 6);
+}
+
+static size_t CompressedBlockBytes(CompressionType compressionType)
+{
+	return (compressionType == CompressionType::BC1 || compressionType == CompressionType::BC4 ? 8 : 16);
+}
+
+void ImageLoader::CompressBlockRows(unsigned char* output, const unsigned char* pixels, Point<int, 2> wh, CompressionType compressionType, size_t startRow, size_t endRow) const
+{
+	const size_t BW = (wh.x() + 3) / 4;
+	const size_t blockBytes = CompressedBlockBytes(compressionType);
+
+	Point<int, 3> whs(wh.x(), wh.y(), wh.x() * 4);
+	unsigned char* bufferData = output + startRow * BW * blockBytes;
+
+	for (int y = startRow * 4; y < int(endRow * 4); y += 4)
+	{
+		// Color blocks go through the four-wide encoders, single channel blocks one at a time.
+		if (compressionType == CompressionType::BC1 || compressionType == CompressionType::BC3 || compressionType == CompressionType::BC7)
+		{
+			BlockGroup group;
+
+			for (size_t blockX = 0; blockX < BW; blockX += 4)
+			{
+				const size_t blockCount = std::min(CST(4), BW - blockX);
+
+				GatherBlocks(pixels, Point<int, 2>(int(blockX * 4), y), whs, group);
+
+				if (compressionType == CompressionType::BC1) CompressBlocksBC1(bufferData, blockBytes, group, blockCount, config.compressionMode);
+				else if (compressionType == CompressionType::BC3) CompressBlocksBC1(bufferData + 8, blockBytes, group, blockCount, config.compressionMode);
+				else CompressBlocksBC7(bufferData, group, blockCount, config.compressionMode);
+
+				bufferData += blockCount * blockBytes;
+			}
+
+			if (compressionType != CompressionType::BC3) continue;
+
+			// BC3 blocks start with the alpha block.
+			bufferData -= BW * blockBytes;
+		}
+
+		for (int x = 0; x < wh.x(); x += 4)
+		{
+			Point<int, 2> xy(x, y);
+
+			if (compressionType == CompressionType::BC3 || compressionType == CompressionType::BC4)
+			{
+				LoadCompressedBlockBC4(bufferData, pixels, xy, whs, (compressionType == CompressionType::BC3 ? 3 : 0));
+			}
+			else if (compressionType == CompressionType::BC5)
+			{
+				LoadCompressedBlockBC4(bufferData, pixels, xy, whs, 0);
+				LoadCompressedBlockBC4(bufferData + 8, pixels, xy, whs, 1);
+			}
+
+			bufferData += blockBytes;
+		}
+	}
+}
+
+// Block compressors read RGBA8, so grey and two channel levels are widened first.
+static void ExpandToRGBA(std::vector<unsigned char>& pixels, size_t channels)
+{
+	if (channels == 4) return;
+
+	const size_t count = pixels.size() / channels;
+	std::vector<unsigned char> expanded(count * 4);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const unsigned char* pixel = pixels.data() + i * channels;
+		unsigned char* out = expanded.data() + i * 4;
+
+		if (channels == 1) out[0] = out[1] = out[2] = pixel[0];
+		else
+		{
+			// Two channels only come from normal maps, whose Z is rebuilt for formats that store it.
+			const float x = float(pixel[0]) * (2.0f / 255.0f) - 1.0f;
+			const float y = float(pixel[1]) * (2.0f / 255.0f) - 1.0f;
+			out[0] = pixel[0];
+			out[1] = pixel[1];
+			out[2] = C8(std::sqrt(std::max(0.0f, 1.0f - x * x - y * y)) * 127.5f + 128.0f);
+		}
+		out[3] = 255;
+	}
+
+	pixels = std::move(expanded);
+}
+
+void ImageLoader::LoadCompressedPixels(std::vector<unsigned char>& buffer, unsigned char* pixels, Point<int, 2> wh, CompressionType compressionType) const
+{
+	const size_t BW = (wh.x() + 3) / 4;
+	const size_t BH = (wh.y() + 3) / 4;
+
+	buffer.resize((BW * BH) * CompressedBlockBytes(compressionType));
+
+	std::vector<unsigned char> expanded{};
+	if (PixelChannels(&data) != 4)
+	{
+		expanded.assign(pixels, pixels + CST(wh.x()) * wh.y() * PixelChannels(&data));
+		ExpandToRGBA(expanded, PixelChannels(&data));
+		pixels = expanded.data();
+	}
+
+	// Every row of blocks writes its own range of the buffer.
+	Scheduler::ParallelFor(BH, 16, [&](size_t startRow, size_t endRow)
+	{
+		CompressBlockRows(buffer.data(), pixels, wh, compressionType, startRow, endRow);
+	});
+}
+
+float SRGBToLinear(float c)
+{
+	return ((c <= 0.04045f) ? (c / 12.92f) : std::pow((c + 0.055f) / 1.055f, 2.4f));
+}
+
+float LinearToSRGB(float c)
+{
+	c = std::max(0.f, std::min(1.f, c));
+	return ((c <= 0.0031308f) ? (12.92f * c) : (1.055f * std::pow(c, 1.f/2.4f) - 0.055f));
+}
+
+// Linear values are looked up in steps of 1 / SRGB_TABLE_SIZE, fine enough that the dark end stays within one 8-bit level.
+#define SRGB_TABLE_SIZE 8192
+
+static const std::array<float, 256>& SRGBToLinearTable()
+{
+	static const std::array<float, 256> table = []()
+	{
+		std::array<float, 256> values{};
+		for (size_t i = 0; i < values.size(); i++) values[i] = SRGBToLinear(float(i) / 255.0f);
+		return (values);
+	}();
+
+	return (table);
+}
+
+static const std::array<uint8_t, SRGB_TABLE_SIZE>& LinearToSRGBTable()
+{
+	static const std::array<uint8_t, SRGB_TABLE_SIZE> table = []()
+	{
+		std::array<uint8_t, SRGB_TABLE_SIZE> values{};
+		for (size_t i = 0; i < values.size(); i++) values[i] = C8(std::lround(LinearToSRGB((float(i) + 0.5f) / SRGB_TABLE_SIZE) * 255.0f));
+		return (values);
+	}();
+
+	return (table);
+}
+
+static uint8_t EncodeLinear(float value, bool srgb)
+{
+	value = std::clamp(value, 0.0f, 1.0f);
+
+	if (srgb) return (LinearToSRGBTable()[std::min(size_t(value * SRGB_TABLE_SIZE), CST(SRGB_TABLE_SIZE - 1))]);
+
+	return (C8(value * 255.0f + 0.5f));
+}
+
+// Alpha and the two channels of normal maps are never sRGB encoded.
+static bool IsSRGBChannel(size_t channel, size_t channels, bool srgb)
+{
+	return (srgb && (channels == 4 ? channel < 3 : channels == 1));
+}
+
+static double Sinc(double x)
+{
+	if (std::abs(x) < 1e-6) return (1.0);
+
+	x *= 3.14159265358979323846;
+	return (std::sin(x) / x);
+}
+
+static double BesselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+
+	for (size_t k = 1; k < 32; k++)
+	{
+		term *= (x * 0.5 / double(k)) * (x * 0.5 / double(k));
+		sum += term;
+	}
+
+	return (sum);
+}
+
+// Kernel value at distance x, in target pixels, of the windowed sinc filters.
+static double FilterKernel(MipFilter filter, double x)
+{
+	const double radius = 3.0;
+	if (std::abs(x) >= radius) return (0.0);
+
+	if (filter == MipFilter::Lanczos) return (Sinc(x) * Sinc(x / radius));
+
+	const double alpha = 4.0;
+	const double window = x / radius;
+	return (Sinc(x) * BesselI0(alpha * std::sqrt(1.0 - window * window)) / BesselI0(alpha));
+}
+
+/** @brief Source pixels and weights of every target pixel along one axis. */
+struct FilterAxis
+{
+	size_t taps = 0;
+	std::vector<uint32_t> indices; /**< @brief taps source indices per target pixel, clamped to the edge. */
+	std::vector<float> weights;
+};
+
+// Builds the weights of one axis, the box filter covers exactly the source span of each target pixel, so odd sizes lose no pixels.
+static FilterAxis BuildFilterAxis(size_t sourceSize, size_t targetSize, MipFilter filter)
+{
+	const double scale = double(sourceSize) / double(targetSize);
+	const double radius = (filter == MipFilter::Box ? 0.5 : 3.0) * scale;
+
+	FilterAxis axis;
+	axis.taps = size_t(std::ceil(radius * 2.0)) + 1;
+	axis.indices.resize(targetSize * axis.taps);
+	axis.weights.resize(targetSize * axis.taps);
+
+	for (size_t i = 0; i < targetSize; i++)
+	{
+		const double center = (double(i) + 0.5) * scale;
+		const long first = long(std::floor(center - radius));
+
+		double total = 0.0;
+		std::vector<double> weights(axis.taps);
+
+		for (size_t k = 0; k < axis.taps; k++)
+		{
+			const double position = double(first + long(k));
+
+			if (filter == MipFilter::Box) weights[k] = std::max(0.0, std::min(position + 1.0, center + radius) - std::max(position, center - radius));
+			else weights[k] = FilterKernel(filter, (position + 0.5 - center) / scale);
+
+			total += weights[k];
+		}
+
+		for (size_t k = 0; k < axis.taps; k++)
+		{
+			axis.indices[i * axis.taps + k] = C32(std::clamp(first + long(k), 0l, long(sourceSize) - 1));
+			axis.weights[i * axis.taps + k] = float(weights[k] / total);
+		}
 	}
-	else
+
+	return (axis);
+}
+
+static void AccumulateRow(float* sum, const float* row, float weight, size_t count)
+{
+	size_t i = 0;
+
+#ifdef LOADER_SSE2
+	const __m128 scale = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4)
 	{
-		palette[2] = (uint8_t)((4 * int(a0) + 1 * int(a1) + 2) / 5);
-		palette[3] = (uint8_t)((3 * int(a0) + 2 * int(a1) + 2) / 5);
-		palette[4] = (uint8_t)((2 * int(a0) + 3 * int(a1) + 2) / 5);
-		palette[5] = (uint8_t)((1 * int(a0) + 4 * int(a1) + 2) / 5);
-		palette[6] = 0;
-		palette[7] = 255;
+		_mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), _mm_mul_ps(_mm_loadu_ps(row + i), scale)));
 	}
+#endif
 
-	return (palette);
+	for (; i < count; i++) sum[i] += row[i] * weight;
 }
 
-void LoadCompressedBlockBC5(unsigned char* buffer, unsigned char* pixels, Point<int, 2> xy, Point<int, 3> whs, int channel)
+// Exact 2x2 average of 8-bit values that are not sRGB encoded, rounded to nearest.
+static void ReduceRowBox(const unsigned char* top, const unsigned char* bottom, unsigned char* out, size_t width, size_t channels)
 {
-	uint8_t block[16];
-	int idx = 0;
-	uint8_t vMin=255, vMax=0;
+	size_t x = 0;
 
-	for (int dy = 0; dy < 4; dy++)
+#ifdef LOADER_SSE2
+	if (channels == 4)
 	{
-		for (int dx = 0; dx < 4; dx++, idx++)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+
+		// Four source pixels of two rows become two target pixels.
+		for (; x + 2 <= width; x += 2)
 		{
-			Point<int, 2> dxy(dx, dy);
-			Point<uint8_t, 3> rgb = LoadRGBClamped(pixels, xy + dxy, whs);
+			const __m128i upper = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + x * 8));
+			const __m128i lower = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + x * 8));
 
-			uint8_t c = (channel == 0) ? rgb.x() : rgb.y();
-			block[idx] = c;
+			const __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(upper, zero), _mm_unpacklo_epi8(lower, zero));
+			const __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(upper, zero), _mm_unpackhi_epi8(lower, zero));
 
-			vMin = std::min(vMin, c);
-        	vMax = std::max(vMax, c);
+			const __m128i sums = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+			const __m128i average = _mm_srli_epi16(_mm_add_epi16(sums, two), 2);
+
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(average, average));
 		}
 	}
+#endif
 
-	if (vMin == vMax)
+	for (; x < width; x++)
 	{
-		uint8_t a0 = vMax;
-		uint8_t a1 = (uint8_t)std::max(0, vMax - 1);
-		std::array<uint8_t, 8> palette = BuildBC4Palette(a0, a1);
+		for (size_t c = 0; c < channels; c++)
+		{
+			const size_t left = x * 2 * channels + c;
+			const size_t right = left + channels;
+			out[x * channels + c] = C8((top[left] + top[right] + bottom[left] + bottom[right] + 2) >> 2);
+		}
+	}
+}
 
-		uint64_t bits = 0;
-		buffer[0] = a0;
-		buffer[1] = a1;
-		std::memcpy(buffer + 2, &bits, 6);
+// 2x2 average of sRGB encoded values, taken in linear space.
+static void ReduceRowBoxSRGB(const unsigned char* top, const unsigned char* bottom, unsigned char* out, size_t width, size_t channels)
+{
+	const std::array<float, 256>& toLinear = SRGBToLinearTable();
 
-		return;
+	for (size_t x = 0; x < width; x++)
+	{
+		for (size_t c = 0; c < channels; c++)
+		{
+			const size_t left = x * 2 * channels + c;
+			const size_t right = left + channels;
+
+			if (!IsSRGBChannel(c, channels, true))
+			{
+				out[x * channels + c] = C8((top[left] + top[right] + bottom[left] + bottom[right] + 2) >> 2);
+				continue;
+			}
+
+			const float sum = toLinear[top[left]] + toLinear[top[right]] + toLinear[bottom[left]] + toLinear[bottom[right]];
+			out[x * channels + c] = EncodeLinear(sum * 0.25f, true);
+		}
 	}
+}
 
-	uint8_t initial_a0 = vMax;
-	uint8_t initial_a1 = vMin;
+// Filters a sourceWidth by sourceHeight image into the target size with separable weights, first along rows into a float buffer and then down the columns.
+// loadRow(y, row) fills source row y with channels floats per pixel, storeRow(y, row) receives finished target row y.
+template <typename LoadRow, typename StoreRow>
+static void ResampleRows(size_t sourceWidth, size_t sourceHeight, size_t targetWidth, size_t targetHeight, size_t channels, MipFilter filter, const LoadRow& loadRow, const StoreRow& storeRow)
+{
+	const FilterAxis horizontal = BuildFilterAxis(sourceWidth, targetWidth, filter);
+	const FilterAxis vertical = BuildFilterAxis(sourceHeight, targetHeight, filter);
 
-	uint8_t best_a0 = 0, best_a1 = 0;
-	uint64_t bestBits = 0;
-	uint32_t bestError = 0xFFFFFFFFu;
+	const size_t sourceRow = sourceWidth * channels;
+	const size_t targetRow = targetWidth * channels;
+	std::vector<float> rows(sourceHeight * targetRow);
 
-	for (int order = 0; order < 2; order++)
+	Scheduler::ParallelFor(sourceHeight, 64, [&](size_t start, size_t end)
 	{
-		uint8_t a0 = initial_a0, a1 = initial_a1;
-		if (order == 1) {std::swap(a0, a1);}
+		std::vector<float> row(sourceRow);
 
-		std::array<uint8_t, 8> palette = BuildBC4Palette(a0, a1);
-		uint64_t bits = 0;
-		uint32_t error = 0;
-
-		for (int i = 0; i < 16; i++)
+		for (size_t y = start; y < end; y++)
 		{
-			uint8_t v = block[i];
-			int bestJ = 0;
+			loadRow(y, row.data());
 
-			int d = int(v) - int(palette[0]);
-			int bestd2 = d * d;
+			float* out = rows.data() + y * targetRow;
 
-			for (int j = 1; j < 8; j++)
+			for (size_t x = 0; x < targetWidth; x++)
 			{
-				int dd = int(v) - int(palette[j]);
-				int d2 = dd * dd;
-				if (d2 < bestd2) {bestd2 = d2; bestJ = j;}
-			}
+				const uint32_t* indices = horizontal.indices.data() + x * horizontal.taps;
+				const float* weights = horizontal.weights.data() + x * horizontal.taps;
 
-			error += (uint32_t)bestd2;
-			bits |= (uint64_t)(bestJ & 7) << (3 * i);
+				for (size_t k = 0; k < horizontal.taps; k++)
+				{
+					if (weights[k] == 0.0f) continue;
+					AccumulateRow(out + x * channels, row.data() + indices[k] * channels, weights[k], channels);
+				}
+			}
 		}
+	});
 
-		if (error < bestError)
+	Scheduler::ParallelFor(targetHeight, 64, [&](size_t start, size_t end)
+	{
+		std::vector<float> sum(targetRow);
+
+		for (size_t y = start; y < end; y++)
 		{
-			bestError = error;
-			best_a0 = a0;
-			best_a1 = a1;
-			bestBits = bits;
-		}
-	}
+			std::fill(sum.begin(), sum.end(), 0.0f);
 
-	buffer[0] = best_a0;
-	buffer[1] = best_a1;
-	std::memcpy(buffer + 2, &bestBits, 6);
+			const uint32_t* indices = vertical.indices.data() + y * vertical.taps;
+			const float* weights = vertical.weights.data() + y * vertical.taps;
+
+			for (size_t k = 0; k < vertical.taps; k++)
+			{
+				if (weights[k] == 0.0f) continue;
+				AccumulateRow(sum.data(), rows.data() + indices[k] * targetRow, weights[k], targetRow);
+			}
+
+			storeRow(y, sum.data());
+		}
+	});
 }
 
-void ImageLoader::LoadCompressedPixels(std::vector<unsigned char>& buffer, unsigned char* pixels, Point<int, 2> wh, CompressionType compressionType) const
+static void ResampleLevel(const MipLevel& source, MipLevel& target, size_t channels, bool srgb, MipFilter filter)
 {
-	const size_t BW = (wh.x() + 3) / 4;
-	const size_t BH = (wh.y() + 3) / 4;
+	const std::array<float, 256>& toLinear = SRGBToLinearTable();
+	const size_t sourceRow = source.width * channels;
+	const size_t targetRow = target.width * channels;
 
-	Point<int, 3> whs(wh.x(), wh.y(), wh.x() * 4);
+	ResampleRows(source.width, source.height, target.width, target.height, channels, filter, [&](size_t y, float* row)
+	{
+		const unsigned char* pixels = source.pixels.data() + y * sourceRow;
+		for (size_t i = 0; i < sourceRow; i++) row[i] = (IsSRGBChannel(i % channels, channels, srgb) ? toLinear[pixels[i]] : float(pixels[i]) * (1.0f / 255.0f));
+	},
+	[&](size_t y, const float* row)
+	{
+		unsigned char* out = target.pixels.data() + y * targetRow;
+		for (size_t i = 0; i < targetRow; i++) out[i] = EncodeLinear(row[i], IsSRGBChannel(i % channels, channels, srgb));
+	});
+}
 
-	//Load normal maps as RGBA8 instead of RG8!
+static uint8_t EncodeSigned(float value)
+{
+	return (C8(std::clamp(value * 127.5f + 128.0f, 0.0f, 255.0f)));
+}
 
-	//std::vector<unsigned char> pixels{};
-	//LoadPixelsThreaded(pixels);
-	
-	const int pixelSize = (compressionType == CompressionType::BC1 ? 8 : 16);
-	buffer.resize((BW * BH) * pixelSize);
-	unsigned char* bufferData = buffer.data();
+// Decodes the XY stored by normal map pixels to unit vectors, Z is rebuilt and W is kept at one.
+static std::vector<float> DecodeNormals(const MipLevel& level)
+{
+	std::vector<float> vectors(level.width * level.height * 4);
 
-	for (int y = 0; y < wh.y(); y += 4)
+	Scheduler::ParallelFor(level.height, 64, [&](size_t start, size_t end)
 	{
-		for (int x = 0; x < wh.x(); x += 4)
+		for (size_t i = start * level.width; i < end * level.width; i++)
 		{
-			Point<int, 2> xy(x, y);
+			const unsigned char* pixel = level.pixels.data() + i * 2;
+			float* vector = vectors.data() + i * 4;
 
-			if (compressionType == CompressionType::BC1)
-			{
-				LoadCompressedBlockBC1(bufferData, pixels, xy, whs);
-			}
-			else if (compressionType == CompressionType::BC5)
-			{
-				LoadCompressedBlockBC5(bufferData, pixels, xy, whs, 0);
-				LoadCompressedBlockBC5(bufferData + 8, pixels, xy, whs, 1);
-			}
+			const float x = float(pixel[0]) * (2.0f / 255.0f) - 1.0f;
+			const float y = float(pixel[1]) * (2.0f / 255.0f) - 1.0f;
+			float z = std::sqrt(std::max(0.0f, 1.0f - x * x - y * y));
 
-			bufferData += pixelSize;
+			const float length = std::sqrt(x * x + y * y + z * z);
+			if (length < 1e-6f) z = 1.0f;
+			const float scale = (length < 1e-6f ? 1.0f : 1.0f / length);
+
+			vector[0] = x * scale;
+			vector[1] = y * scale;
+			vector[2] = z * scale;
+			vector[3] = 1.0f;
 		}
-	}
+	});
+
+	return (vectors);
 }
 
-float SRGBToLinear(float c)
+// Renormalizes a filtered row of vectors into pixels, the shortening of the average is kept as Toksvig variance when requested.
+static void EncodeNormalRow(const float* vectors, MipLevel& level, size_t y)
 {
-	return ((c <= 0.04045f) ? (c / 12.92f) : std::pow((c + 0.055f) / 1.055f, 2.4f));
+	unsigned char* out = level.pixels.data() + y * level.width * 2;
+	unsigned char* variance = (level.variance.empty() ? nullptr : level.variance.data() + y * level.width);
+
+	for (size_t x = 0; x < level.width; x++)
+	{
+		const float* vector = vectors + x * 4;
+		const float length = std::sqrt(vector[0] * vector[0] + vector[1] * vector[1] + vector[2] * vector[2]);
+		const float scale = (length < 1e-6f ? 0.0f : 1.0f / length);
+
+		out[x * 2] = EncodeSigned(vector[0] * scale);
+		out[x * 2 + 1] = EncodeSigned(vector[1] * scale);
+
+		// Normals that cancel out are treated as fully rough.
+		if (variance) variance[x] = EncodeLinear(length < 1e-6f ? 1.0f : (1.0f - std::min(length, 1.0f)) / length, false);
+	}
 }
 
-float LinearToSRGB(float c)
+// Filters the unnormalized vectors of each level into the next, so every level averages the normals of its whole footprint before renormalizing.
+// Normal map pixels always hold the two channels chosen by PixelChannels.
+static void GenerateNormalMipmaps(std::vector<MipLevel>& mipmaps, MipFilter filter, bool variance)
 {
-	c = std::max(0.f, std::min(1.f, c));
-	return ((c <= 0.0031308f) ? (12.92f * c) : (1.055f * std::pow(c, 1.f/2.4f) - 0.055f));
+	std::vector<float> vectors = DecodeNormals(mipmaps[0]);
+	if (variance) mipmaps[0].variance.assign(mipmaps[0].width * mipmaps[0].height, 0);
+
+	for (size_t i = 1; i < mipmaps.size(); i++)
+	{
+		const MipLevel& previous = mipmaps[i - 1];
+		MipLevel& current = mipmaps[i];
+
+		current.width = std::max(CST(1), previous.width >> 1);
+		current.height = std::max(CST(1), previous.height >> 1);
+		current.level = i;
+		current.pixels.resize(current.width * current.height * 2);
+		if (variance) current.variance.resize(current.width * current.height);
+
+		std::vector<float> filtered(current.width * current.height * 4);
+
+		ResampleRows(previous.width, previous.height, current.width, current.height, 4, filter, [&](size_t y, float* row)
+		{
+			std::memcpy(row, vectors.data() + y * previous.width * 4, previous.width * 4 * sizeof(float));
+		},
+		[&](size_t y, const float* row)
+		{
+			std::memcpy(filtered.data() + y * current.width * 4, row, current.width * 4 * sizeof(float));
+			EncodeNormalRow(row, current, y);
+		});
+
+		vectors = std::move(filtered);
+	}
 }
 
 std::vector<MipLevel> ImageLoader::LoadMipmaps(size_t mipLevels, bool srgb) const
@@ -1449,66 +4459,46 @@ std::vector<MipLevel> ImageLoader::LoadMipmaps(size_t mipLevels, bool srgb) cons
 	mipmaps[0].level = 0;
 	LoadPixelsThreaded(mipmaps[0].pixels);
 
-	int level = 0;
-	for (int i = 1; i < mipLevels; i++)
+	const size_t channels = PixelChannels(&data);
+
+	// Normal maps are never sRGB encoded and are averaged as vectors instead of colors.
+	if (channels == 2)
 	{
-		const int prevLevel = i - 1;
-		const int prevWidth = mipmaps[prevLevel].width;
-		const int prevHeight = mipmaps[prevLevel].height;
-		const int currentWidth = std::max(1, prevWidth >> 1);
-		const int currentHeight = std::max(1, prevHeight >> 1);
+		GenerateNormalMipmaps(mipmaps, config.mipFilter, config.normalVariance);
+		return (mipmaps);
+	}
 
-		mipmaps[i].width = currentWidth;
-		mipmaps[i].height = currentHeight;
-		mipmaps[i].level = i;
-		mipmaps[i].pixels.resize((currentWidth * currentHeight) * 4);
+	for (size_t i = 1; i < mipLevels; i++)
+	{
+		const MipLevel& previous = mipmaps[i - 1];
+		MipLevel& current = mipmaps[i];
 
-		for (int y = 0; y < currentHeight; y++)
-		{
-			for (int x = 0; x < currentWidth; x++)
-			{
-				int sx = x * 2;
-				int sy = y * 2;
+		current.width = std::max(CST(1), previous.width >> 1);
+		current.height = std::max(CST(1), previous.height >> 1);
+		current.level = i;
+		current.pixels.resize(current.width * current.height * channels);
 
-				point4D totalRGB(0.0f);
-				for (int dy = 0; dy < 2; dy++)
-				{
-					for (int dx = 0; dx < 2; dx++)
-					{
-						int index = ((sy + dy) * prevWidth + (sx + dx)) * 4;
-						point4D currentRGB;
-						currentRGB.x() = float(mipmaps[prevLevel].pixels[index]) / 255.0f;
-						currentRGB.y() = float(mipmaps[prevLevel].pixels[index + 1]) / 255.0f;
-						currentRGB.z() = float(mipmaps[prevLevel].pixels[index + 2]) / 255.0f;
-						currentRGB.w() = float(mipmaps[prevLevel].pixels[index + 3]) / 255.0f;
-
-						if (srgb)
-						{
-							currentRGB.x() = SRGBToLinear(currentRGB.x());
-							currentRGB.y() = SRGBToLinear(currentRGB.y());
-							currentRGB.z() = SRGBToLinear(currentRGB.z());
-						}
-
-						totalRGB += currentRGB;
-					}
-				}
+		// Even sizes with the box filter are an exact 2x2 reduction, everything else goes through the separable filter.
+		if (config.mipFilter != MipFilter::Box || previous.width != current.width * 2 || previous.height != current.height * 2)
+		{
+			ResampleLevel(previous, current, channels, srgb, config.mipFilter);
+			continue;
+		}
 
-				totalRGB *= 0.25f;
+		const size_t sourceRow = previous.width * channels;
+		const size_t targetRow = current.width * channels;
 
-				if (srgb)
-				{
-					totalRGB.x() = LinearToSRGB(totalRGB.x());
-					totalRGB.y() = LinearToSRGB(totalRGB.y());
-					totalRGB.z() = LinearToSRGB(totalRGB.z());
-				}
+		Scheduler::ParallelFor(current.height, 64, [&](size_t startRow, size_t endRow)
+		{
+			for (size_t y = startRow; y < endRow; y++)
+			{
+				const unsigned char* top = previous.pixels.data() + y * 2 * sourceRow;
+				unsigned char* out = current.pixels.data() + y * targetRow;
 
-				int index = (y * currentWidth + x) * 4;
-				mipmaps[i].pixels[index] = (uint8_t)std::lround(std::clamp(totalRGB.x(), 0.0f, 1.0f) * 255.0f);
-				mipmaps[i].pixels[index + 1] = (uint8_t)std::lround(std::clamp(totalRGB.y(), 0.0f, 1.0f) * 255.0f);
-				mipmaps[i].pixels[index + 2] = (uint8_t)std::lround(std::clamp(totalRGB.z(), 0.0f, 1.0f) * 255.0f);
-				mipmaps[i].pixels[index + 3] = (uint8_t)std::lround(std::clamp(totalRGB.w(), 0.0f, 1.0f) * 255.0f);
+				if (srgb) ReduceRowBoxSRGB(top, top + sourceRow, out, current.width, channels);
+				else ReduceRowBox(top, top + sourceRow, out, current.width, channels);
 			}
-		}
+		});
 	}
 
 	return (mipmaps);
@@ -1519,16 +4509,45 @@ std::vector<MipLevel> ImageLoader::LoadCompressedMipmaps(size_t mipLevels, bool
 	std::vector<MipLevel> mipmaps = LoadMipmaps(mipLevels, srgb);
 	std::vector<MipLevel> compressedMipmaps(mipLevels);
 
-	for (int i = 0; i < mipLevels; i++)
+	for (MipLevel& mipmap : mipmaps) ExpandToRGBA(mipmap.pixels, PixelChannels(&data));
+
+	// Tiles of whole block rows from every level share one pass, so the small levels never run on their own.
+	struct Tile
+	{
+		size_t level = 0;
+		size_t startRow = 0;
+		size_t endRow = 0;
+	};
+
+	std::vector<Tile> tiles;
+	const size_t tileBlocks = 1024;
+
+	for (size_t i = 0; i < mipLevels; i++)
 	{
 		compressedMipmaps[i].width = mipmaps[i].width;
 		compressedMipmaps[i].height = mipmaps[i].height;
 		compressedMipmaps[i].level = mipmaps[i].level;
+		compressedMipmaps[i].variance = std::move(mipmaps[i].variance);
 
-		Point<int, 2> wh(mipmaps[i].width, mipmaps[i].height);
-		LoadCompressedPixels(compressedMipmaps[i].pixels, mipmaps[i].pixels.data(), wh, compressionType);
+		const size_t BW = (mipmaps[i].width + 3) / 4;
+		const size_t BH = (mipmaps[i].height + 3) / 4;
+		compressedMipmaps[i].pixels.resize(BW * BH * CompressedBlockBytes(compressionType));
+
+		const size_t tileRows = std::max(CST(1), tileBlocks / BW);
+		for (size_t row = 0; row < BH; row += tileRows) tiles.push_back({i, row, std::min(row + tileRows, BH)});
 	}
 
+	Scheduler::ParallelFor(tiles.size(), 1, [&](size_t start, size_t end)
+	{
+		for (size_t i = start; i < end; i++)
+		{
+			const Tile& tile = tiles[i];
+			Point<int, 2> wh(mipmaps[tile.level].width, mipmaps[tile.level].height);
+
+			CompressBlockRows(compressedMipmaps[tile.level].pixels.data(), mipmaps[tile.level].pixels.data(), wh, compressionType, tile.startRow, tile.endRow);
+		}
+	});
+
 	return (compressedMipmaps);
 }
 
@@ -1537,6 +4556,26 @@ EntropyReader::EntropyReader(ByteReader& br) : br(br)
 	
 }
 
+void EntropyReader::Restart()
+{
+	bitBuffer = 0;
+	bitCount = 0;
+	markerReached = false;
+
+	while (br.BytesLeft() > 1)
+	{
+		if (br.Peek8() == 0xFF && br.Peek8(1) >= C8(ImageMarker::RST0) && br.Peek8(1) <= C8(ImageMarker::RST7))
+		{
+			br.Skip(2);
+			return;
+		}
+
+		br.Skip(1);
+	}
+
+	throw (std::runtime_error("Restart marker not found"));
+}
+
 int EntropyReader::Extend(int v, int n)
 {
 	int vt = 1 << (n - 1);
@@ -1544,95 +4583,146 @@ int EntropyReader::Extend(int v, int n)
 }
 
 void EntropyReader::AddBitsBuffer()
-{			
-	uint8_t byte = br.Read8();
-
-	if (byte == 0x00 && previous == 0xFF)
+{
+	if (!markerReached && br.BytesLeft() >= 8)
 	{
-		previous = byte;
-		AddBitsBuffer();
-		return;
-	}
-
-	previous = byte;
+		const uint64_t word = br.Peek64();
+		const uint64_t inverted = ~word;
 
-	bitBuffer = ((bitBuffer << 8) | byte);
+		if (((inverted - 0x0101010101010101ull) & ~inverted & 0x8080808080808080ull) == 0)
+		{
+			const size_t bytes = (64 - bitCount) >> 3;
+			const uint64_t chunk = (bytes == 8 ? word : (word >> (64 - bytes * 8)));
 
-	index -= 8;
-}
+			bitBuffer |= chunk << (64 - bitCount - bytes * 8);
+			bitCount += bytes * 8;
+			br.Skip(bytes);
 
-void EntropyReader::ReadBitBuffer()
-{
-	while (index >= 8) AddBitsBuffer();
+			return;
+		}
+	}
 
-	bitValue = (bitBuffer & (1 << (15 - index))) != 0;
-	index++;
+	AddBitsStuffed();
 }
 
-HuffmanResult EntropyReader::FindCode(const std::string& code, HuffmanTree& root) const
+void EntropyReader::AddBitsStuffed()
 {
-	HuffmanResult result = {false, {}};
-	HuffmanTree* node = &root;
-
-	for (size_t i = 0; i < code.size(); i++)
+	while (bitCount <= 56)
 	{
-		BinaryTreeSide side = (code[i] == '0' ? Left : Right);
+		uint64_t byte = 0;
 
-		if (!node->HasSide(side)) return (result);
+		if (!markerReached && br.BytesLeft() > 0)
+		{
+			byte = br.Peek8();
+
+			if (byte == 0xFF)
+			{
+				if (br.BytesLeft() > 1 && br.Peek8(1) == 0x00)
+				{
+					br.Skip(2);
+				}
+				else
+				{
+					markerReached = true;
+					byte = 0;
+				}
+			}
+			else
+			{
+				br.Skip(1);
+			}
+		}
+		else
+		{
+			markerReached = true;
+		}
 
-		node = node->GetSide(side);
-		if (node->GetValue().first && (i + 1 == code.size())) return (node->GetValue());
+		bitBuffer |= byte << (56 - bitCount);
+		bitCount += 8;
 	}
+}
 
-	return (result);
+int EntropyReader::PeekBits(size_t amount) const
+{
+	return (CI(bitBuffer >> (64 - amount)));
 }
 
-uint8_t EntropyReader::NextSymbolFast(const HuffmanTree& tree)
+void EntropyReader::SkipBits(size_t amount)
 {
-	const HuffmanTree* node = &tree;
+	bitBuffer <<= amount;
+	bitCount -= amount;
+}
 
-	while (true)
+uint8_t EntropyReader::DecodeSymbol(const HuffmanTable& table)
+{
+	const int code = PeekBits(16);
+
+	for (size_t length = FAST_BITS + 1; length <= 16; length++)
 	{
-		ReadBitBuffer();
+		const int current = code >> (16 - length);
 
-		node = node->GetSide(bitValue ? Right : Left);
-		HuffmanResult result = node->GetValue();
-		if (result.first)
+		if (current <= table.maxCode[length])
 		{
-			return (result.second.symbol);
+			SkipBits(length);
+			return (table.symbols[current + table.valueOffset[length]]);
 		}
 	}
+
+	throw (std::runtime_error("Invalid huffman code"));
 }
 
-std::pair<bool, uint8_t> EntropyReader::NextSymbolFast(const std::array<int16_t, 1 << FAST_BITS>& table, const std::vector<HuffmanCode>& codes)
+HuffmanValue EntropyReader::DecodeValue(const HuffmanTable& table)
 {
-	while (index >= 8) AddBitsBuffer();
+	if (bitCount < 32) AddBitsBuffer();
+
+	const HuffmanEntry& entry = table.lookup[PeekBits(FAST_BITS)];
+
+	if (entry.totalLength)
+	{
+		SkipBits(entry.totalLength);
+		return (HuffmanValue{entry.symbol, entry.value});
+	}
 
-	uint16_t val = bitBuffer;
+	HuffmanValue result{};
 
-	val = val << index;
-	int key = (val >> (16 - FAST_BITS)) & ((1 << FAST_BITS) - 1);
-	int fastResult = table[key];
+	if (entry.codeLength)
+	{
+		SkipBits(entry.codeLength);
+		result.symbol = entry.symbol;
+	}
+	else
+	{
+		result.symbol = DecodeSymbol(table);
+	}
 
-	if (fastResult >= 0)
+	const size_t size = result.symbol & 0x0F;
+	if (size > 0)
 	{
-		int length = codes[fastResult].length;
-		index += length;
-		return (std::pair<bool, uint8_t>{true, codes[fastResult].symbol});
+		result.value = Extend(PeekBits(size), size);
+		SkipBits(size);
 	}
 
-	return (std::pair<bool, uint8_t>{false, 0});
+	return (result);
+}
+
+int EntropyReader::ReadBits(size_t amount)
+{
+	if (amount == 0) return (0);
+	if (bitCount < amount) AddBitsBuffer();
+
+	int result = PeekBits(amount);
+	SkipBits(amount);
+
+	return (result);
 }
 
 int EntropyReader::ReadBitsBuffer(size_t amount)
 {
-	int result = 0;
+	if (amount == 0) return (0);
+	if (bitCount < amount) AddBitsBuffer();
 
-	for (size_t i = 0; i < amount; i++)
-	{
-		ReadBitBuffer();
-		if (bitValue) result += pow(2, (amount - (i + 1)));
-	}
+	int result = PeekBits(amount);
+	SkipBits(amount);
 
 	return (Extend(result, amount));
 }
@@ -1644,19 +4734,25 @@ ImageLoader* GetNewLoader(std::pair<std::string, ImageType> config)
 
 std::vector<ImageLoader*> ImageLoader::LoadImages(const std::vector<std::pair<std::string, ImageType>>& images)
 {
-	std::vector<ImageLoader*> imageLoaders(images.size());
-	std::vector<std::future<ImageLoader*>> threads(images.size());
+	std::vector<ImageLoader*> imageLoaders(images.size(), nullptr);
+	TaskGroup group;
 
 	double start = Time::GetCurrentTime();
 
-	for (size_t i = 0; i < threads.size(); i++)
+	// Images are tasks of the shared scheduler, their stages split into further tasks that idle workers steal.
+	for (size_t i = 0; i < images.size(); i++)
 	{
-		threads[i] = (std::async(GetNewLoader, images[i]));
+		Scheduler::Submit(group, [&imageLoaders, &images, i]() { imageLoaders[i] = GetNewLoader(images[i]); });
 	}
 
-	for (size_t i = 0; i < threads.size(); i++)
+	try
 	{
-		imageLoaders[i] = (threads[i].get());
+		Scheduler::Wait(group);
+	}
+	catch (...)
+	{
+		for (ImageLoader* imageLoader : imageLoaders) delete imageLoader;
+		throw;
 	}
 
 	std::cout << "Image loading took: " << (Time::GetCurrentTime() - start) * 1000 << " ms." << std::endl;
@@ -1664,6 +4760,115 @@ std::vector<ImageLoader*> ImageLoader::LoadImages(const std::vector<std::pair<st
 	return (imageLoaders);
 }
 
+void ImageLoader::SaveKtx2(const std::string& path, const std::vector<MipLevel>& levels, VkFormat format)
+{
+	if (!IsKtx2Format(format)) throw (std::runtime_error("Unsupported KTX2 format"));
+	if (levels.empty()) throw (std::runtime_error("No mip levels to save"));
+
+	const size_t blockBytes = FormatBlockBytes(format);
+	const bool srgb = (format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK);
+
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		if (levels[i].pixels.size() != LevelBytes(format, levels[i].width, levels[i].height)) throw (std::runtime_error("Mip level size does not match format"));
+	}
+
+	// Basic data format descriptor: one sample per channel for RGBA8, one sample per 64 or 128 bits of block for the block formats.
+	std::vector<uint32_t> samples;
+	uint32_t colorModel = 1;
+
+	const uint32_t signedQualifier = (format == VK_FORMAT_BC4_SNORM_BLOCK || format == VK_FORMAT_BC5_SNORM_BLOCK ? 0x40u : 0u);
+	const uint32_t lower = (signedQualifier ? 0x80000000u : 0u);
+	const uint32_t upper = (signedQualifier ? 0x7FFFFFFFu : 0xFFFFFFFFu);
+
+	if (!blockBytes)
+	{
+		const uint32_t channels[4] = {0, 1, 2, 15};
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			const uint32_t linear = (srgb && i == 3 ? 0x10u : 0u);
+			samples.insert(samples.end(), {(i * 8) | (7u << 16) | ((channels[i] | linear) << 24), 0, 0, 255});
+		}
+	}
+	else if (format == VK_FORMAT_BC4_UNORM_BLOCK || format == VK_FORMAT_BC4_SNORM_BLOCK)
+	{
+		colorModel = 131;
+		samples.insert(samples.end(), {(63u << 16) | (signedQualifier << 24), 0, lower, upper});
+	}
+	else if (blockBytes == 8)
+	{
+		colorModel = 128;
+		const uint32_t channel = (format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ? 1 : 0);
+		samples.insert(samples.end(), {(63u << 16) | (channel << 24), 0, 0, 0xFFFFFFFFu});
+	}
+	else if (format == VK_FORMAT_BC3_UNORM_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK)
+	{
+		colorModel = 130;
+		const uint32_t linear = (srgb ? 0x10u : 0u);
+		samples.insert(samples.end(), {(63u << 16) | ((15u | linear) << 24), 0, 0, 0xFFFFFFFFu});
+		samples.insert(samples.end(), {64u | (63u << 16), 0, 0, 0xFFFFFFFFu});
+	}
+	else if (format == VK_FORMAT_BC7_UNORM_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK)
+	{
+		colorModel = 134;
+		samples.insert(samples.end(), {(127u << 16), 0, 0, 0xFFFFFFFFu});
+	}
+	else
+	{
+		colorModel = 132;
+		samples.insert(samples.end(), {(63u << 16) | (signedQualifier << 24), 0, lower, upper});
+		samples.insert(samples.end(), {64u | (63u << 16) | ((1u | signedQualifier) << 24), 0, lower, upper});
+	}
+
+	const uint32_t blockDimension = (blockBytes ? 3u | (3u << 8) : 0u);
+	const uint32_t planeBytes = CUI(blockBytes ? blockBytes : 4);
+	const uint32_t descriptorSize = CUI(24 + samples.size() * 4);
+
+	std::vector<uint32_t> descriptor = {descriptorSize + 4, 0, 2u | (descriptorSize << 16), colorModel | (1u << 8) | ((srgb ? 2u : 1u) << 16), blockDimension, planeBytes, 0};
+	descriptor.insert(descriptor.end(), samples.begin(), samples.end());
+
+	Ktx2Header header{};
+	header.format = CUI(format);
+	header.typeSize = 1;
+	header.width = CUI(levels[0].width);
+	header.height = CUI(levels[0].height);
+	header.faceCount = 1;
+	header.levelCount = CUI(levels.size());
+	header.DFDOffset = CUI(ktx2Identifier.size() + sizeof(header) + levels.size() * sizeof(Ktx2Level));
+	header.DFDLength = CUI(descriptor.size() * 4);
+
+	// Levels are stored smallest first, each aligned to the texel block size.
+	const size_t alignment = std::lcm(CST(planeBytes), CST(4));
+	std::vector<Ktx2Level> levelIndex(levels.size());
+	size_t offset = header.DFDOffset + header.DFDLength;
+
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		offset = (offset + alignment - 1) / alignment * alignment;
+		levelIndex[i].offset = offset;
+		levelIndex[i].length = levels[i].pixels.size();
+		levelIndex[i].uncompressedLength = levels[i].pixels.size();
+		offset += levels[i].pixels.size();
+	}
+
+	std::vector<uint8_t> output(offset, 0);
+	std::memcpy(output.data(), ktx2Identifier.data(), ktx2Identifier.size());
+	std::memcpy(output.data() + ktx2Identifier.size(), &header, sizeof(header));
+	std::memcpy(output.data() + ktx2Identifier.size() + sizeof(header), levelIndex.data(), levelIndex.size() * sizeof(Ktx2Level));
+	std::memcpy(output.data() + header.DFDOffset, descriptor.data(), header.DFDLength);
+
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		std::memcpy(output.data() + levelIndex[i].offset, levels[i].pixels.data(), levels[i].pixels.size());
+	}
+
+	std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+	if (!stream.is_open()) throw (std::runtime_error("Failed to open file: " + path));
+
+	stream.write(reinterpret_cast<const char*>(output.data()), output.size());
+	if (!stream.good()) throw (std::runtime_error("Failed to write file: " + path));
+}
+
 std::ostream& operator<<(std::ostream& out, const ImageInfo& info)
 {
 	out << VAR_VAL(info.startOfFrameInfo.start) << std::endl;
@@ -121,6 +121,7 @@ void Manager::DestroyVulkan()
 	{
 		swapchain.Destroy();
 		Renderer::Destroy();
+		Image::DestroyMipmapPipeline();
 		Descriptor::DestroyPools();
 		Command::DestroyPools();
 		window.DestroySurface();
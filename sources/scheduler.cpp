@@ -0,0 +1,216 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <chrono>
+
+TaskGroup::TaskGroup()
+{
+
+}
+
+TaskGroup::~TaskGroup()
+{
+
+}
+
+bool TaskGroup::Finished() const
+{
+	return (remaining.load(std::memory_order_acquire) == 0);
+}
+
+Scheduler::Pool::~Pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	sleepCondition.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		if (worker.joinable()) worker.join();
+	}
+}
+
+void Scheduler::Create(size_t threadCount)
+{
+	std::call_once(poolFlag, [threadCount]()
+	{
+		size_t count = threadCount;
+		if (count == 0) count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+		pool = std::make_unique<Pool>();
+
+		// The queue at index count belongs to threads outside the pool.
+		for (size_t i = 0; i <= count; i++) pool->queues.push_back(std::make_unique<Queue>());
+		for (size_t i = 0; i < count; i++) pool->workers.emplace_back(Work, std::ref(*pool), i);
+	});
+}
+
+void Scheduler::Destroy()
+{
+	pool.reset();
+}
+
+Scheduler::Pool& Scheduler::GetPool()
+{
+	if (!pool) Create();
+	if (!pool) throw (std::runtime_error("Scheduler was destroyed"));
+
+	return (*pool);
+}
+
+void Scheduler::Work(Pool& current, size_t index)
+{
+	workerIndex = index;
+
+	while (true)
+	{
+		if (RunTask(current, index)) continue;
+
+		std::unique_lock<std::mutex> lock(current.sleepMutex);
+		current.sleepCondition.wait(lock, [&current]() { return (current.stopping || current.queued.load() > 0); });
+
+		if (current.stopping && current.queued.load() == 0) return;
+	}
+}
+
+bool Scheduler::RunTask(Pool& current, size_t index)
+{
+	const size_t queueCount = current.queues.size();
+
+	std::function<void()> task;
+
+	// Own tasks are taken newest first, which keeps nested work close to the data it was split from.
+	{
+		Queue& own = *current.queues[std::min(index, queueCount - 1)];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+		}
+	}
+
+	for (size_t i = 1; !task && i < queueCount; i++)
+	{
+		Queue& victim = *current.queues[(index + i) % queueCount];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+		}
+	}
+
+	if (!task) return (false);
+
+	current.queued.fetch_sub(1);
+	task();
+
+	return (true);
+}
+
+void Scheduler::Submit(TaskGroup& group, std::function<void()> task)
+{
+	Pool& current = GetPool();
+
+	group.remaining.fetch_add(1);
+
+	auto wrapped = [&group, task = std::move(task)]()
+	{
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(group.exceptionMutex);
+			if (!group.exception) group.exception = std::current_exception();
+		}
+
+		group.remaining.fetch_sub(1, std::memory_order_release);
+	};
+
+	const size_t external = current.queues.size() - 1;
+	size_t index = (workerIndex < external ? workerIndex : current.nextQueue.fetch_add(1) % current.queues.size());
+
+	// Counted before it is published, a worker stealing it right away would otherwise wrap the count below zero.
+	{
+		std::lock_guard<std::mutex> lock(current.sleepMutex);
+		current.queued.fetch_add(1);
+	}
+
+	{
+		Queue& queue = *current.queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(wrapped));
+	}
+
+	current.sleepCondition.notify_one();
+}
+
+void Scheduler::Wait(TaskGroup& group)
+{
+	Pool& current = GetPool();
+	const size_t index = std::min(workerIndex, current.queues.size() - 1);
+
+	while (!group.Finished())
+	{
+		if (RunTask(current, index)) continue;
+
+		// Nothing left to help with, so sleep instead of spinning on a core while the last tasks finish.
+		std::unique_lock<std::mutex> lock(current.sleepMutex);
+		current.sleepCondition.wait_for(lock, std::chrono::microseconds(200), [&current, &group]()
+		{
+			return (group.Finished() || current.queued.load() > 0);
+		});
+	}
+
+	std::lock_guard<std::mutex> lock(group.exceptionMutex);
+	if (group.exception)
+	{
+		std::exception_ptr exception = group.exception;
+		group.exception = nullptr;
+		std::rethrow_exception(exception);
+	}
+}
+
+void Scheduler::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+	if (count == 0) return;
+
+	grain = std::max(grain, size_t(1));
+	if (count <= grain) return (body(0, count));
+
+	TaskGroup group;
+
+	for (size_t start = grain; start < count; start += grain)
+	{
+		const size_t end = std::min(start + grain, count);
+		Submit(group, [&body, start, end]() { body(start, end); });
+	}
+
+	// The calling thread takes the first range itself instead of waiting idle.
+	try
+	{
+		body(0, grain);
+	}
+	catch (...)
+	{
+		Wait(group);
+		throw;
+	}
+
+	Wait(group);
+}
+
+size_t Scheduler::GetThreadCount()
+{
+	return (GetPool().workers.size() + 1);
+}
+
+std::unique_ptr<Scheduler::Pool> Scheduler::pool = nullptr;
+std::once_flag Scheduler::poolFlag;
+thread_local size_t Scheduler::workerIndex = SIZE_MAX;
@@ -117,7 +117,7 @@ std::vector<std::string> Utilities::FileToLines(const std::string& path)
 	return (result);
 }*/
 
-std::pair<size_t, size_t> Utilities::FindPair(const std::string& string, size_t begin, const std::pair<char, char>& pair)
+std::pair<size_t, size_t> Utilities::FindPair(std::string_view string, size_t begin, const std::pair<char, char>& pair)
 {
 	std::pair<size_t, size_t> result(begin, begin);
 